@@ -0,0 +1,142 @@
+// History search benchmark. Builds a synthetic history and times backward substring searches
+// through the trigram index against a plain strstr scan over every entry, then times the
+// reverse-i-search fuzzy filter one keystroke at a time.
+//
+// Usage: history_bench [entries]
+#include <time.h>
+
+#include "../include/trigram.h"
+#include "../include/fuzzy.h"
+
+#define DEFAULT_ENTRIES 1000000
+#define NUM_SEARCHES 200
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static ssize_t linear_find(const s_vector* entries, ssize_t current_index, const char* needle)
+{
+    size_t needle_length = strlen(needle);
+
+    for (; current_index >= 0; current_index--)
+    {
+        const char* entry = entries->data[current_index];
+        if (strstr(entry, needle) && strlen(entry) > needle_length)
+            return current_index;
+    }
+
+    return -1;
+}
+
+// Commands people repeat, with enough varying arguments that most lines are distinct
+static void synthetic_history(s_vector* entries, size_t num_entries)
+{
+    static const char* const formats[] =
+    {
+        "git commit -m 'fix issue %u'",
+        "make -j8 target_%u",
+        "cd ~/projects/service_%u/src",
+        "grep -rn handler_%u include src",
+        "ssh build-%u.example.com",
+        "vim src/module_%u.c",
+        "ls -la /var/log/app_%u",
+    };
+    size_t num_formats = sizeof(formats) / sizeof(*formats);
+
+    char line[256];
+    srand(1);
+    for (size_t i = 0; i < num_entries; i++)
+    {
+        snprintf(line, sizeof(line), formats[rand() % num_formats], (unsigned int)rand() % 100000);
+        add_string(entries, line, true);
+    }
+}
+
+static void bench(const s_vector* entries, trigram_index* index, const char* needle)
+{
+    ssize_t expected = 0;
+    ssize_t found = 0;
+
+    double start = now_seconds();
+    for (int i = 0; i < NUM_SEARCHES; i++)
+        expected = linear_find(entries, (ssize_t)entries->size - 1 - i, needle);
+    double linear = (now_seconds() - start) / NUM_SEARCHES;
+
+    start = now_seconds();
+    for (int i = 0; i < NUM_SEARCHES; i++)
+        found = trigram_index_find(index, entries, (ssize_t)entries->size - 1 - i, needle);
+    double indexed = (now_seconds() - start) / NUM_SEARCHES;
+
+    if (found != expected)
+    {
+        fprintf(stderr, "'%s': index found %ld, scan found %ld\n", needle, found, expected);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-24s linear %10.3f ms   trigram %8.4f ms\n", needle, linear * 1e3, indexed * 1e3);
+}
+
+// Types query one character at a time, the way reverse-i-search re-filters, and reports the slowest keystroke
+static void bench_fuzzy(const s_vector* entries, fuzzy_index* index, const char* query)
+{
+    fuzzy_result results[FUZZY_MAX_RESULTS];
+    char typed[256] = {0};
+    double slowest = 0;
+    double total = 0;
+    size_t num_results = 0;
+
+    for (size_t i = 0; query[i] && i < sizeof(typed) - 1; i++)
+    {
+        typed[i] = query[i];
+
+        double start = now_seconds();
+        num_results = fuzzy_search(index, entries, NULL, typed, results, FUZZY_MAX_RESULTS);
+        double elapsed = now_seconds() - start;
+
+        total += elapsed;
+        if (elapsed > slowest) { slowest = elapsed; }
+    }
+
+    printf("%-24s fuzzy  %10.3f ms per key, slowest %.3f ms, best '%s'\n", query, total * 1e3 / strlen(query),
+           slowest * 1e3, num_results ? entries->data[results[0].index] : "");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_entries = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ENTRIES;
+
+    s_vector entries = {NULL, 0, 0};
+    synthetic_history(&entries, num_entries);
+
+    trigram_index index = {0};
+    double start = now_seconds();
+    trigram_index_update(&index, &entries, SIZE_MAX);
+    printf("%lu entries, %lu trigrams, indexed in %.1f ms\n", entries.size, index.size, (now_seconds() - start) * 1e3);
+
+    // Common, rare, and missing needles
+    bench(&entries, &index, "git commit");
+    bench(&entries, &index, "service_4242");
+    bench(&entries, &index, "handler_99999 include");
+    bench(&entries, &index, "not in the history");
+
+    // Built ahead of the first search, the way the shell does it while waiting for input
+    fuzzy_index fuzzy = {0};
+    start = now_seconds();
+    fuzzy_index_update(&fuzzy, &entries);
+    printf("fuzzy data built in %.1f ms\n", (now_seconds() - start) * 1e3);
+
+    bench_fuzzy(&entries, &fuzzy, "gcm fix");
+    bench_fuzzy(&entries, &fuzzy, "mk trgt_42");
+    bench_fuzzy(&entries, &fuzzy, "SSH build-7");
+    bench_fuzzy(&entries, &fuzzy, "zzz");
+
+    fuzzy_index_free(&fuzzy);
+    trigram_index_free(&index);
+    free_s_vector(&entries);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+// Lexer throughput benchmark. Tokenizes large script inputs line by line, the way script mode does,
+// once with the scalar word scan and once with the vectorized one, and reports MB/s.
+//
+// Usage: lex_bench [script...]
+// Without arguments a synthetic script of SYNTHETIC_SIZE bytes is generated
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "../include/lexer.h"
+
+#define SYNTHETIC_SIZE (32 * 1024 * 1024)
+#define MIN_BENCH_SECONDS 1.0
+
+typedef struct corpus
+{
+    char* data;
+    size_t size;
+    const char* name;
+} corpus;
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append(corpus* c, size_t* capacity, const char* text, size_t length)
+{
+    while (c->size + length + 1 > *capacity)
+    {
+        *capacity = *capacity ? *capacity << 1 : 4096;
+        c->data = realloc(c->data, *capacity);
+        if (!c->data)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(c->data + c->size, text, length);
+    c->size += length;
+}
+
+// A mix of what generated build and batch scripts look like: compiler lines, pipelines with
+// redirections, quoted arguments, and long file lists
+static corpus synthetic_corpus()
+{
+    corpus c = { NULL, 0, "synthetic" };
+    size_t capacity = 0;
+    char line[256];
+
+    for (unsigned int n = 0; c.size < SYNTHETIC_SIZE; n++)
+    {
+        int length = 0;
+
+        switch (n % 4)
+        {
+            case 0:
+                length = snprintf(line, sizeof(line), "gcc -Wall -Wextra -O2 -Iinclude -c src/module_%u.c -o build/module_%u.o\n", n, n);
+                append(&c, &capacity, line, length);
+                break;
+            case 1:
+                length = snprintf(line, sizeof(line), "grep -rn \"pattern %u\" logs/run_%u.log | sort -u | head -n 20 > out/%u.txt\n", n, n, n);
+                append(&c, &capacity, line, length);
+                break;
+            case 2:
+                length = snprintf(line, sizeof(line), "echo 'step %u done' ; touch stamps/step_%u &\n", n, n);
+                append(&c, &capacity, line, length);
+                break;
+            case 3:
+                append(&c, &capacity, "tar -czf archive.tgz", 20);
+                for (unsigned int k = 0; k < 200; k++)
+                {
+                    length = snprintf(line, sizeof(line), " artifacts/build_%u/object_file_%u.o", n, k);
+                    append(&c, &capacity, line, length);
+                }
+                append(&c, &capacity, "\n", 1);
+                break;
+        }
+    }
+
+    return c;
+}
+
+static corpus file_corpus(const char* path)
+{
+    corpus c = { NULL, 0, path };
+
+    int fd = open(path, O_RDONLY);
+    struct stat s;
+    if (fd == -1 || fstat(fd, &s) == -1)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    c.data = malloc(s.st_size + 1);
+    if (!c.data)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t total = 0;
+    ssize_t nread;
+    while (total < (size_t)s.st_size && (nread = read(fd, c.data + total, s.st_size - total)) > 0)
+        total += nread;
+
+    // tokenize wants every line to end with a separator
+    if (!total || c.data[total - 1] != '\n')
+        c.data[total++] = '\n';
+
+    c.size = total;
+    close(fd);
+
+    return c;
+}
+
+// Tokenizes every line of the corpus once. Returns the number of tokens
+static size_t lex_corpus(arena* a, corpus* c)
+{
+    size_t num_tokens = 0;
+    size_t start = 0;
+
+    while (start < c->size)
+    {
+        char* newline = memchr(c->data + start, '\n', c->size - start);
+        size_t length = newline ? (size_t)(newline - (c->data + start)) + 1 : c->size - start;
+
+        token_vector tokens = {0};
+        tokenize(a, &tokens, c->data + start, length);
+        num_tokens += tokens.size;
+        arena_reset(a);
+
+        start += length;
+    }
+
+    return num_tokens;
+}
+
+static void bench(corpus* c, bool simd)
+{
+    const char* backend = lexer_set_simd(simd);
+    arena a = {0};
+
+    // Warm up caches and the arena
+    size_t num_tokens = lex_corpus(&a, c);
+
+    size_t iterations = 0;
+    double start = now_seconds();
+    double elapsed = 0;
+    do
+    {
+        lex_corpus(&a, c);
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < MIN_BENCH_SECONDS);
+
+    double megabytes = (double)c->size * iterations / (1024 * 1024);
+    printf("%-12s %-7s %10.1f MB/s %12.1f Mtokens/s  (%lu bytes, %lu tokens, %lu iterations)\n",
+           c->name, backend, megabytes / elapsed, (double)num_tokens * iterations / elapsed / 1e6,
+           c->size, num_tokens, iterations);
+
+    arena_free(&a);
+}
+
+int main(int argc, char* argv[])
+{
+    // tokenize reports unterminated quotes on stderr, which would only slow down the measurement
+    freopen("/dev/null", "w", stderr);
+
+    for (int i = 0; i < (argc > 1 ? argc - 1 : 1); i++)
+    {
+        corpus c = argc > 1 ? file_corpus(argv[i + 1]) : synthetic_corpus();
+
+        bench(&c, false);
+        bench(&c, true);
+
+        free(c.data);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,429 @@
+// Microbenchmarks of the per-keystroke and per-line primitives: tokenize, parse_commands (parse_tokens
+// without running anything), line editing, s_vector growth and truncation, and history search.
+// Each one reports ns/op, heap allocations per op counted by wrapping malloc, and throughput.
+//
+// Usage: micro_bench [script...]
+// Without arguments a synthetic corpus of SYNTHETIC_LINES lines is generated. Scripts, or a recorded
+// history dumped one line per entry, are used line by line as they are
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "../include/shell.h"
+
+#define SYNTHETIC_LINES 20000
+#define MIN_BENCH_SECONDS 0.5
+#define LINE_EDITS 512
+#define VECTOR_STRINGS 1024
+#define HISTORY_QUERIES 64
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* data, size_t size);
+
+// Only allocations made while an operation is being timed are counted
+static bool counting = false;
+static size_t allocations = 0;
+
+void* malloc(size_t size)
+{
+    allocations += counting;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    allocations += counting;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* data, size_t size)
+{
+    allocations += counting;
+    return __libc_realloc(data, size);
+}
+
+typedef struct corpus
+{
+    char* data;
+    size_t size;
+    const char* name;
+
+    char** lines; // Each ends with its '\n'
+    size_t* lengths;
+    char** strings; // The lines as C strings
+    size_t num_lines;
+} corpus;
+
+// A benchmark runs setup, which isn't measured, then op, which does ops_per_call operations over bytes_per_call bytes
+typedef struct benchmark
+{
+    const char* name;
+    void (*setup)(corpus* c);
+    void (*op)(corpus* c);
+    size_t ops_per_call;
+    size_t bytes_per_call;
+} benchmark;
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append(corpus* c, size_t* capacity, const char* text, size_t length)
+{
+    while (c->size + length + 1 > *capacity)
+    {
+        *capacity = *capacity ? *capacity << 1 : 4096;
+        c->data = realloc(c->data, *capacity);
+        if (!c->data)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memcpy(c->data + c->size, text, length);
+    c->size += length;
+}
+
+// Interactive-sized command lines: single commands, pipelines, redirections, quoting and lists
+static corpus synthetic_corpus()
+{
+    corpus c = { .name = "synthetic" };
+    size_t capacity = 0;
+    char line[256];
+
+    for (unsigned int n = 0; n < SYNTHETIC_LINES; n++)
+    {
+        int length = 0;
+
+        switch (n % 6)
+        {
+            case 0: length = snprintf(line, sizeof(line), "ls -la src/module_%u\n", n); break;
+            case 1: length = snprintf(line, sizeof(line), "git commit -m 'fix issue %u in the parser'\n", n); break;
+            case 2: length = snprintf(line, sizeof(line), "grep -rn handler_%u src include | sort | head -n 20 > out/%u.txt\n", n, n); break;
+            case 3: length = snprintf(line, sizeof(line), "make -j8 target_%u ; ./bin/test_%u < input/%u.txt &\n", n, n, n); break;
+            case 4: length = snprintf(line, sizeof(line), "cd ~/projects/service_%u/src\n", n); break;
+            case 5: length = snprintf(line, sizeof(line), "echo \"build %u\"done ; cat log_%u.txt | wc -l\n", n, n); break;
+        }
+
+        append(&c, &capacity, line, length);
+    }
+
+    return c;
+}
+
+static corpus file_corpus(const char* path)
+{
+    corpus c = { .name = path };
+
+    int fd = open(path, O_RDONLY);
+    struct stat s;
+    if (fd == -1 || fstat(fd, &s) == -1)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    c.data = malloc(s.st_size + 1);
+    if (!c.data)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t total = 0;
+    ssize_t nread;
+    while (total < (size_t)s.st_size && (nread = read(fd, c.data + total, s.st_size - total)) > 0)
+        total += nread;
+
+    // tokenize wants every line to end with a separator
+    if (!total || c.data[total - 1] != '\n')
+        c.data[total++] = '\n';
+
+    c.size = total;
+    close(fd);
+
+    return c;
+}
+
+static void split_lines(corpus* c)
+{
+    for (size_t i = 0; i < c->size; i++) { c->num_lines += c->data[i] == '\n'; }
+
+    c->lines = malloc(c->num_lines * sizeof(*c->lines));
+    c->lengths = malloc(c->num_lines * sizeof(*c->lengths));
+    c->strings = malloc(c->num_lines * sizeof(*c->strings));
+    if (!c->lines || !c->lengths || !c->strings)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i < c->num_lines; i++)
+    {
+        char* newline = memchr(c->data + start, '\n', c->size - start);
+        c->lines[i] = c->data + start;
+        c->lengths[i] = (size_t)(newline - (c->data + start)) + 1;
+        c->strings[i] = strndup(c->lines[i], c->lengths[i] - 1);
+        start += c->lengths[i];
+    }
+}
+
+// tokenize
+
+static arena token_arena = {0};
+
+static void tokenize_op(corpus* c)
+{
+    for (size_t i = 0; i < c->num_lines; i++)
+    {
+        token_vector tokens = {0};
+        tokenize(&token_arena, &tokens, c->lines[i], c->lengths[i]);
+        arena_reset(&token_arena);
+    }
+}
+
+// parse_commands, over lines tokenized beforehand
+
+static token_vector* line_tokens = NULL;
+
+static void parse_setup(corpus* c)
+{
+    if (line_tokens) { return; }
+
+    line_tokens = calloc(c->num_lines, sizeof(*line_tokens));
+    if (!line_tokens)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    // Lines that don't tokenize never reach the parser
+    for (size_t i = 0; i < c->num_lines; i++)
+    {
+        if (!tokenize(&token_arena, &line_tokens[i], c->lines[i], c->lengths[i]))
+            line_tokens[i].size = 0;
+    }
+}
+
+static void parse_op(corpus* c)
+{
+    for (size_t i = 0; i < c->num_lines; i++)
+    {
+        s_vector words = {0};
+        command* commands;
+        size_t num_commands;
+        if (parse_commands(&line_tokens[i], c->lines[i], &words, &commands, &num_commands))
+            restore_tokens(&line_tokens[i], c->lines[i]);
+
+        arena_reset(&line_arena);
+    }
+}
+
+// Line editing
+
+static line bench_line = {0};
+
+static void line_setup(corpus* c)
+{
+    UNUSED(c);
+
+    if (!bench_line.data) { initialize_line(&bench_line); }
+    clear_line(&bench_line);
+}
+
+static void insert_end_op(corpus* c)
+{
+    UNUSED(c);
+
+    for (size_t i = 0; i < LINE_EDITS; i++) { insert_character(&bench_line, 'a' + i % 26); }
+}
+
+// Half the characters go at the end, the other half into the middle of them
+static void insert_middle_op(corpus* c)
+{
+    UNUSED(c);
+
+    for (size_t i = 0; i < LINE_EDITS / 2; i++) { insert_character(&bench_line, 'a' + i % 26); }
+    move_line_cursor_x(&bench_line, -(int)(LINE_EDITS / 4));
+    for (size_t i = 0; i < LINE_EDITS / 2; i++) { insert_character(&bench_line, 'a' + i % 26); }
+}
+
+static void remove_setup(corpus* c)
+{
+    line_setup(c);
+
+    char text[LINE_EDITS];
+    memset(text, 'a', sizeof(text));
+    line_insert(&bench_line, text, sizeof(text));
+}
+
+static void remove_op(corpus* c)
+{
+    UNUSED(c);
+
+    for (size_t i = 0; i < LINE_EDITS; i++) { remove_character(&bench_line); }
+}
+
+// s_vector
+
+static s_vector bench_vector = {0};
+
+// Starts every add_string run from an empty vector, with no capacity left over
+static void vector_setup(corpus* c)
+{
+    UNUSED(c);
+
+    if (bench_vector.size) { erase(&bench_vector, 0); }
+    free(bench_vector.data);
+    bench_vector = (s_vector){0};
+}
+
+static void add_string_op(corpus* c)
+{
+    for (size_t i = 0; i < VECTOR_STRINGS; i++) { add_string(&bench_vector, c->strings[i % c->num_lines], true); }
+}
+
+static void erase_setup(corpus* c)
+{
+    vector_setup(c);
+    add_string_op(c);
+}
+
+static void erase_op(corpus* c)
+{
+    UNUSED(c);
+
+    erase(&bench_vector, 0);
+}
+
+// History search, with the corpus as the history
+
+static s_vector bench_history = {0};
+static char* queries[HISTORY_QUERIES];
+
+static void history_setup(corpus* c)
+{
+    if (bench_history.size) { return; }
+
+    for (size_t i = 0; i < c->num_lines; i++) { add_string(&bench_history, c->strings[i], true); }
+
+    // Pieces of entries spread over the history, so matches are found at every depth
+    for (size_t i = 0; i < HISTORY_QUERIES; i++)
+    {
+        const char* entry = bench_history.data[(i * 7919) % bench_history.size];
+        size_t length = strlen(entry);
+        size_t start = length > 12 ? (i * 31) % (length - 8) : 0;
+        queries[i] = strndup(entry + start, length - start < 8 ? length - start : 8);
+    }
+
+    // The first search indexes the whole history
+    history_search(&bench_history, bench_history.size - 1, queries[0]);
+}
+
+static void history_op(corpus* c)
+{
+    UNUSED(c);
+
+    for (size_t i = 0; i < HISTORY_QUERIES; i++)
+        history_search(&bench_history, bench_history.size - 1, queries[i]);
+}
+
+static void run_benchmark(const benchmark* b, corpus* c)
+{
+    // Warm up caches, arenas and the line's buffer
+    if (b->setup) { b->setup(c); }
+    b->op(c);
+
+    size_t calls = 0;
+    size_t allocated = 0;
+    double elapsed = 0;
+    while (elapsed < MIN_BENCH_SECONDS)
+    {
+        if (b->setup) { b->setup(c); }
+
+        allocations = 0;
+        counting = true;
+        double start = now_seconds();
+        b->op(c);
+        elapsed += now_seconds() - start;
+        counting = false;
+
+        allocated += allocations;
+        calls++;
+    }
+
+    double ops = (double)calls * b->ops_per_call;
+    printf("%-24s %10.1f ns/op %8.3f allocs/op", b->name, elapsed * 1e9 / ops, allocated / ops);
+
+    if (b->bytes_per_call)
+        printf(" %10.1f MB/s\n", (double)b->bytes_per_call * calls / elapsed / (1024 * 1024));
+    else
+        printf(" %10.2f Mops/s\n", ops / elapsed / 1e6);
+}
+
+static void free_corpus(corpus* c)
+{
+    if (line_tokens)
+    {
+        free(line_tokens);
+        line_tokens = NULL;
+        arena_reset(&token_arena);
+    }
+
+    if (bench_history.size)
+    {
+        // Also drops the search index built over it
+        history_free(&bench_history);
+        for (size_t i = 0; i < HISTORY_QUERIES; i++) { free(queries[i]); }
+    }
+
+    for (size_t i = 0; i < c->num_lines; i++) { free(c->strings[i]); }
+    free(c->strings);
+    free(c->lines);
+    free(c->lengths);
+    free(c->data);
+}
+
+int main(int argc, char* argv[])
+{
+    // tokenize and the parser report syntax errors on stderr, which would only slow down the measurement
+    freopen("/dev/null", "w", stderr);
+
+    for (int i = 0; i < (argc > 1 ? argc - 1 : 1); i++)
+    {
+        corpus c = argc > 1 ? file_corpus(argv[i + 1]) : synthetic_corpus();
+        split_lines(&c);
+        if (!c.num_lines) { continue; }
+
+        const benchmark benchmarks[] =
+        {
+            { "tokenize", NULL, tokenize_op, c.num_lines, c.size },
+            { "parse_commands", parse_setup, parse_op, c.num_lines, c.size },
+            { "insert_character end", line_setup, insert_end_op, LINE_EDITS, 0 },
+            { "insert_character middle", line_setup, insert_middle_op, LINE_EDITS, 0 },
+            { "remove_character", remove_setup, remove_op, LINE_EDITS, 0 },
+            { "add_string", vector_setup, add_string_op, VECTOR_STRINGS, 0 },
+            { "erase", erase_setup, erase_op, VECTOR_STRINGS, 0 },
+            { "history_search", history_setup, history_op, HISTORY_QUERIES, 0 },
+        };
+
+        printf("%s: %lu bytes, %lu lines\n", c.name, c.size, c.num_lines);
+        for (size_t j = 0; j < sizeof(benchmarks) / sizeof(*benchmarks); j++) { run_benchmark(&benchmarks[j], &c); }
+        printf("\n");
+
+        free_corpus(&c);
+    }
+
+    clear_line_and_free(&bench_line);
+    free_s_vector(&bench_vector);
+    arena_free(&token_arena);
+
+    return EXIT_SUCCESS;
+}
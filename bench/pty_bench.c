@@ -0,0 +1,596 @@
+// Interactive latency benchmark. Runs the shell under a pseudo-terminal, replays keystroke traces into it
+// and measures, for every keystroke, the time until the first byte the shell writes back and how many bytes
+// it writes in response. Cursor position queries are answered from a rough model of the screen, so the
+// shell never sits out its query timeout.
+//
+// Usage: pty_bench [-n runs] shell trace...
+//
+// A trace is a text file with one action per line:
+//   type TEXT          every character of TEXT is one keystroke
+//   key NAME...        enter tab escape backspace delete up down left right ctrl-left ctrl-right,
+//                      and ctrl-a to ctrl-z
+//   paste TEXT         TEXT as one bracketed paste
+//   resize COLS ROWS   the terminal changes size, the redraw is part of the next keystroke's output
+//   repeat N ACTION    ACTION N times over
+// Blank lines and lines starting with '#' are skipped. \n, \t, \e and \\ in TEXT stand for themselves.
+// Each run starts a fresh shell with an empty history file
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#define DEFAULT_RUNS 5
+#define DEFAULT_COLUMNS 80
+#define DEFAULT_ROWS 24
+
+// A keystroke's response is over once the shell has been quiet this long. Enter runs a command,
+// whose output can come in bursts, so it gets longer
+#define QUIET_MS 3
+#define ENTER_QUIET_MS 50
+// A keystroke nothing came back for within this long wrote nothing
+#define NO_OUTPUT_MS 100
+#define STARTUP_MS 2000
+
+typedef struct action
+{
+    char* bytes;
+    size_t size;
+    int columns; // Nonzero for a resize
+    int rows;
+} action;
+
+typedef struct trace
+{
+    char* name;
+    action* actions;
+    size_t num_actions;
+    size_t capacity;
+
+    double* latencies; // Seconds, of the keystrokes that got a response
+    size_t num_latencies;
+    size_t latency_capacity;
+
+    size_t keystrokes;
+    size_t silent; // Keystrokes nothing came back for
+    size_t bytes;
+} trace;
+
+// Just enough of a terminal to know where the cursor is when the shell asks
+typedef struct screen_model
+{
+    int columns;
+    int rows;
+    int x;
+    int y;
+    int state; // 0 text, 1 after escape, 2 in a CSI sequence
+    char params[32];
+    size_t num_params;
+} screen_model;
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* checked_realloc(void* data, size_t size)
+{
+    void* temp = realloc(data, size);
+    if (!temp)
+    {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    return temp;
+}
+
+static void add_action(trace* t, const char* bytes, size_t size, int columns, int rows)
+{
+    if (t->num_actions == t->capacity)
+    {
+        t->capacity = t->capacity ? t->capacity << 1 : 64;
+        t->actions = checked_realloc(t->actions, t->capacity * sizeof(action));
+    }
+
+    action* a = &t->actions[t->num_actions++];
+    a->bytes = checked_realloc(NULL, size ? size : 1);
+    if (size) { memcpy(a->bytes, bytes, size); }
+    a->size = size;
+    a->columns = columns;
+    a->rows = rows;
+}
+
+static void add_latency(trace* t, double seconds)
+{
+    if (t->num_latencies == t->latency_capacity)
+    {
+        t->latency_capacity = t->latency_capacity ? t->latency_capacity << 1 : 256;
+        t->latencies = checked_realloc(t->latencies, t->latency_capacity * sizeof(double));
+    }
+
+    t->latencies[t->num_latencies++] = seconds;
+}
+
+// Unescapes text in place, returning its new length
+static size_t unescape(char* text)
+{
+    size_t n = 0;
+    for (size_t i = 0; text[i]; i++)
+    {
+        if (text[i] != '\\' || !text[i + 1])
+        {
+            text[n++] = text[i];
+            continue;
+        }
+
+        switch (text[++i])
+        {
+            case 'n': text[n++] = '\n'; break;
+            case 't': text[n++] = '\t'; break;
+            case 'e': text[n++] = '\033'; break;
+            default: text[n++] = text[i]; break;
+        }
+    }
+
+    return n;
+}
+
+static bool key_bytes(const char* name, char* out, size_t* size)
+{
+    static const struct { const char* name; const char* bytes; } keys[] =
+    {
+        { "enter", "\r" },
+        { "tab", "\t" },
+        { "escape", "\033" },
+        { "backspace", "\177" },
+        { "delete", "\033[3~" },
+        { "up", "\033[A" },
+        { "down", "\033[B" },
+        { "right", "\033[C" },
+        { "left", "\033[D" },
+        { "ctrl-right", "\033[1;5C" },
+        { "ctrl-left", "\033[1;5D" },
+    };
+
+    for (size_t i = 0; i < sizeof(keys) / sizeof(*keys); i++)
+    {
+        if (!strcmp(name, keys[i].name))
+        {
+            *size = strlen(keys[i].bytes);
+            memcpy(out, keys[i].bytes, *size);
+            return true;
+        }
+    }
+
+    if (!strncmp(name, "ctrl-", 5) && name[5] >= 'a' && name[5] <= 'z' && !name[6])
+    {
+        out[0] = name[5] - 'a' + 1;
+        *size = 1;
+        return true;
+    }
+
+    return false;
+}
+
+// Adds the actions of one trace line, returning false if it isn't one
+static bool parse_action(trace* t, char* text)
+{
+    char* rest = strchr(text, ' ');
+    if (rest) { *rest++ = '\0'; }
+    else { rest = text + strlen(text); }
+
+    if (!strcmp(text, "repeat"))
+    {
+        char* end;
+        long count = strtol(rest, &end, 10);
+        if (end == rest || *end != ' ' || count < 0) { return false; }
+
+        for (long i = 0; i < count; i++)
+        {
+            // Parsing consumes the text, so every repetition gets its own copy
+            char* copy = strdup(end + 1);
+            bool ok = parse_action(t, copy);
+            free(copy);
+            if (!ok) { return false; }
+        }
+
+        return true;
+    }
+
+    if (!strcmp(text, "type"))
+    {
+        size_t n = unescape(rest);
+        for (size_t i = 0; i < n; i++) { add_action(t, rest + i, 1, 0, 0); }
+        return true;
+    }
+
+    if (!strcmp(text, "paste"))
+    {
+        size_t n = unescape(rest);
+        char* bytes = checked_realloc(NULL, n + 12);
+        memcpy(bytes, "\033[200~", 6);
+        memcpy(bytes + 6, rest, n);
+        memcpy(bytes + 6 + n, "\033[201~", 6);
+        add_action(t, bytes, n + 12, 0, 0);
+        free(bytes);
+        return true;
+    }
+
+    if (!strcmp(text, "key"))
+    {
+        for (char* name = strtok(rest, " "); name; name = strtok(NULL, " "))
+        {
+            char bytes[16];
+            size_t size;
+            if (!key_bytes(name, bytes, &size)) { return false; }
+            add_action(t, bytes, size, 0, 0);
+        }
+
+        return true;
+    }
+
+    if (!strcmp(text, "resize"))
+    {
+        int columns, rows;
+        if (sscanf(rest, "%d %d", &columns, &rows) != 2 || columns <= 0 || rows <= 0) { return false; }
+
+        add_action(t, NULL, 0, columns, rows);
+        return true;
+    }
+
+    return false;
+}
+
+static void load_trace(trace* t, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    // Named after the file, without its directory and extension
+    const char* slash = strrchr(path, '/');
+    char* name = strdup(slash ? slash + 1 : path);
+    char* dot = strrchr(name, '.');
+    if (dot && dot != name) { *dot = '\0'; }
+    t->name = name;
+
+    char* text = NULL;
+    size_t text_capacity = 0;
+    ssize_t length;
+    size_t line_number = 0;
+    while ((length = getline(&text, &text_capacity, file)) != -1)
+    {
+        line_number++;
+        if (length && text[length - 1] == '\n') { text[--length] = '\0'; }
+        if (!length || text[0] == '#') { continue; }
+
+        if (!parse_action(t, text))
+        {
+            fprintf(stderr, "%s:%lu: not a trace action\n", path, line_number);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    free(text);
+    fclose(file);
+}
+
+static void write_all(int fd, const char* bytes, size_t size)
+{
+    while (size)
+    {
+        ssize_t n = write(fd, bytes, size);
+        if (n == -1)
+        {
+            if (errno == EINTR) { continue; }
+
+            perror("write");
+            exit(EXIT_FAILURE);
+        }
+
+        bytes += n;
+        size -= n;
+    }
+}
+
+static int clamp(int value, int low, int high)
+{
+    return value < low ? low : (value > high ? high : value);
+}
+
+static void csi_sequence(screen_model* s, char final, int master)
+{
+    s->params[s->num_params] = '\0';
+    int n = s->num_params ? atoi(s->params) : 0;
+    int count = n ? n : 1;
+
+    switch (final)
+    {
+        case 'A': s->y -= count; break;
+        case 'B': s->y += count; break;
+        case 'C': s->x += count; break;
+        case 'D': s->x -= count; break;
+        case 'G': s->x = count - 1; break;
+        case 'H':
+        {
+            int row = 1, column = 1;
+            sscanf(s->params, "%d;%d", &row, &column);
+            s->y = row - 1;
+            s->x = column - 1;
+            break;
+        }
+        case 'n':
+            if (n == 6)
+            {
+                char report[32];
+                int size = snprintf(report, sizeof(report), "\033[%d;%dR", s->y + 1, s->x + 1);
+                write_all(master, report, (size_t)size);
+            }
+            break;
+    }
+
+    s->x = clamp(s->x, 0, s->columns - 1);
+    s->y = clamp(s->y, 0, s->rows - 1);
+}
+
+// Follows the cursor through what the shell wrote and answers its position queries
+static void feed(screen_model* s, const char* bytes, size_t size, int master)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        char c = bytes[i];
+
+        if (s->state == 1)
+        {
+            s->state = c == '[' ? 2 : 0;
+            s->num_params = 0;
+            continue;
+        }
+
+        if (s->state == 2)
+        {
+            if (c >= 0x40 && c <= 0x7e)
+            {
+                csi_sequence(s, c, master);
+                s->state = 0;
+            }
+            else if (s->num_params < sizeof(s->params) - 1)
+            {
+                s->params[s->num_params++] = c;
+            }
+            continue;
+        }
+
+        if (c == '\033') { s->state = 1; }
+        else if (c == '\r') { s->x = 0; }
+        else if (c == '\n') { s->y = clamp(s->y + 1, 0, s->rows - 1); }
+        else if (c == '\b') { s->x = clamp(s->x - 1, 0, s->columns - 1); }
+        else if ((unsigned char)c >= 0x20 && c != 0x7f && ((unsigned char)c & 0xc0) != 0x80)
+        {
+            // Past the last column the text continues on the next row
+            if (++s->x >= s->columns)
+            {
+                s->x = 0;
+                s->y = clamp(s->y + 1, 0, s->rows - 1);
+            }
+        }
+    }
+}
+
+// Reads what the shell writes until it has been quiet for quiet_ms, waiting up to first_ms for it to start.
+// Returns how many bytes came, and sets *first to when the first of them did
+static size_t read_response(int master, screen_model* s, int first_ms, int quiet_ms, double* first)
+{
+    char buffer[65536];
+    size_t total = 0;
+    int timeout = first_ms;
+
+    while (true)
+    {
+        struct pollfd pfd = { .fd = master, .events = POLLIN };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready == -1)
+        {
+            if (errno == EINTR) { continue; }
+
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+        if (ready == 0) { return total; }
+
+        ssize_t n = read(master, buffer, sizeof(buffer));
+        // The shell exited
+        if (n <= 0) { return total; }
+
+        if (!total) { *first = now_seconds(); }
+        total += n;
+        feed(s, buffer, (size_t)n, master);
+        timeout = quiet_ms;
+    }
+}
+
+static void set_size(int master, screen_model* s, int columns, int rows)
+{
+    struct winsize size = { .ws_row = rows, .ws_col = columns };
+    if (ioctl(master, TIOCSWINSZ, &size) == -1)
+    {
+        perror("TIOCSWINSZ");
+        exit(EXIT_FAILURE);
+    }
+
+    s->columns = columns;
+    s->rows = rows;
+    s->x = clamp(s->x, 0, columns - 1);
+    s->y = clamp(s->y, 0, rows - 1);
+}
+
+static void run_trace(trace* t, const char* shell)
+{
+    char history[] = "/tmp/pty_bench_history_XXXXXX";
+    int history_fd = mkstemp(history);
+    if (history_fd == -1)
+    {
+        perror("mkstemp");
+        exit(EXIT_FAILURE);
+    }
+    close(history_fd);
+
+    struct winsize size = { .ws_row = DEFAULT_ROWS, .ws_col = DEFAULT_COLUMNS };
+    int master;
+    pid_t pid = forkpty(&master, NULL, NULL, &size);
+    if (pid == -1)
+    {
+        perror("forkpty");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pid == 0)
+    {
+        setenv("RASH_HISTORY", history, 1);
+        setenv("TERM", "xterm-256color", 1);
+        execl(shell, shell, (char*)NULL);
+        perror(shell);
+        _exit(127);
+    }
+
+    screen_model s = { .columns = DEFAULT_COLUMNS, .rows = DEFAULT_ROWS };
+    double first;
+
+    if (!read_response(master, &s, STARTUP_MS, ENTER_QUIET_MS, &first))
+    {
+        fprintf(stderr, "%s: no prompt\n", shell);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < t->num_actions; i++)
+    {
+        const action* a = &t->actions[i];
+
+        if (a->columns)
+        {
+            set_size(master, &s, a->columns, a->rows);
+            continue;
+        }
+
+        // Whatever is still coming from the last keystroke belongs to it
+        t->bytes += read_response(master, &s, 0, QUIET_MS, &first);
+
+        bool enter = memchr(a->bytes, '\r', a->size) != NULL;
+        double sent = now_seconds();
+        write_all(master, a->bytes, a->size);
+
+        size_t n = read_response(master, &s, NO_OUTPUT_MS, enter ? ENTER_QUIET_MS : QUIET_MS, &first);
+        t->keystrokes++;
+        t->bytes += n;
+
+        if (n) { add_latency(t, first - sent); }
+        else { t->silent++; }
+    }
+
+    close(master);
+    kill(pid, SIGHUP);
+    waitpid(pid, NULL, 0);
+    unlink(history);
+}
+
+static int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, size_t n, double p)
+{
+    if (!n) { return 0; }
+
+    size_t i = (size_t)(p / 100.0 * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+static void report(const char* name, double* latencies, size_t n, size_t keystrokes, size_t silent, size_t bytes)
+{
+    qsort(latencies, n, sizeof(double), compare_doubles);
+
+    printf("%-16s %8lu %8lu %10.1f %10.1f %10.1f %12.1f\n", name, keystrokes, silent,
+           percentile(latencies, n, 50) * 1e6, percentile(latencies, n, 99) * 1e6,
+           n ? latencies[n - 1] * 1e6 : 0.0, keystrokes ? (double)bytes / keystrokes : 0.0);
+}
+
+int main(int argc, char** argv)
+{
+    long runs = DEFAULT_RUNS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        if (opt == 'n' && (runs = strtol(optarg, NULL, 10)) > 0) { continue; }
+
+        fprintf(stderr, "Usage: %s [-n runs] shell trace...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (argc - optind < 2)
+    {
+        fprintf(stderr, "Usage: %s [-n runs] shell trace...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // A shell that dies early shouldn't take the benchmark with it
+    signal(SIGPIPE, SIG_IGN);
+
+    const char* shell = argv[optind];
+    size_t num_traces = argc - optind - 1;
+    trace* traces = calloc(num_traces, sizeof(trace));
+    if (!traces)
+    {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < num_traces; i++) { load_trace(&traces[i], argv[optind + 1 + i]); }
+
+    printf("%ld runs of each trace, latency from keystroke to first output byte in us\n\n", runs);
+    printf("%-16s %8s %8s %10s %10s %10s %12s\n", "trace", "keys", "silent", "p50", "p99", "max", "bytes/key");
+
+    trace all = {0};
+    for (size_t i = 0; i < num_traces; i++)
+    {
+        trace* t = &traces[i];
+        for (long run = 0; run < runs; run++) { run_trace(t, shell); }
+
+        for (size_t j = 0; j < t->num_latencies; j++) { add_latency(&all, t->latencies[j]); }
+        all.keystrokes += t->keystrokes;
+        all.silent += t->silent;
+        all.bytes += t->bytes;
+
+        report(t->name, t->latencies, t->num_latencies, t->keystrokes, t->silent, t->bytes);
+    }
+
+    if (num_traces > 1)
+        report("all", all.latencies, all.num_latencies, all.keystrokes, all.silent, all.bytes);
+
+    for (size_t i = 0; i < num_traces; i++)
+    {
+        for (size_t j = 0; j < traces[i].num_actions; j++) { free(traces[i].actions[j].bytes); }
+        free(traces[i].name);
+        free(traces[i].actions);
+        free(traces[i].latencies);
+    }
+    free(traces);
+    free(all.latencies);
+
+    return EXIT_SUCCESS;
+}
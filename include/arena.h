@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#define ARENA_MIN_BLOCK_SIZE 4096
+
+typedef struct arena_block
+{
+    struct arena_block* next;
+    size_t capacity;
+    size_t used;
+    char data[];
+} arena_block;
+
+// Bump allocator for everything that only lives as long as one input line.
+// Blocks double in size when full, and a reset keeps the newest (largest) one,
+// so once warmed up a line costs no malloc calls at all
+typedef struct arena
+{
+    arena_block* head;
+} arena;
+
+void* arena_alloc(arena* a, size_t size);
+void* arena_calloc(arena* a, size_t count, size_t size);
+char* arena_strndup(arena* a, const char* s, size_t n);
+void arena_reset(arena* a);
+void arena_free(arena* a);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// Slots in the name lookup table, a power of two well above the number of builtins
+#define BUILTIN_TABLE_SIZE 64
+// Longest printf conversion spec, from the % to the conversion character
+#define PRINTF_MAX_SPEC 60
+
+// A builtin gets its arguments like main does, argv[argc] is NULL, and returns its exit status
+typedef int (*builtin_function)(int argc, char** argv);
+
+typedef struct builtin
+{
+    const char* name;
+    builtin_function run;
+} builtin;
+
+// Builtins and keywords, for completion
+extern const char* builtin_names[];
+extern const size_t num_builtin_names;
+
+// Set once echo or printf wrote something that didn't end with a line break
+extern bool builtin_line_open;
+
+void builtin_init();
+const builtin* builtin_find(const char* name);
+bool is_keyword(const char* name);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef COMMAND_HASH_H
+#define COMMAND_HASH_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "s_vector.h"
+
+// Minimum time between two stat() sweeps over the PATH directories
+#define HASH_RECHECK_INTERVAL_MS 1000
+
+typedef struct hash_entry
+{
+    char* name;
+    char* path;
+    size_t hits;
+} hash_entry;
+
+// Open addressing table mapping a command name to the absolute path of the
+// executable it resolved to. The mtime of every PATH directory is remembered
+// so the whole table can be dropped when one of them changes.
+typedef struct command_hash
+{
+    hash_entry* entries;
+    size_t size;
+    size_t capacity;
+
+    struct timespec* dir_mtimes;
+    size_t num_dirs;
+    struct timespec last_check;
+} command_hash;
+
+extern command_hash cmd_hash;
+
+const char* hash_lookup(command_hash* table, const s_vector* paths, const char* name);
+bool hash_validate(command_hash* table, const s_vector* paths, bool force);
+void hash_clear(command_hash* table);
+void hash_free(command_hash* table);
+void hash_print(const command_hash* table);
+bool is_executable_file(const char* path_name);
+
+#endif
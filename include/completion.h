@@ -0,0 +1,90 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "arena.h"
+#include "redirect.h"
+#include "s_vector.h"
+
+// Directory listings kept for path completion, the least recently used one makes room for a new one
+#define COMPLETION_CACHE_SIZE 16
+// Buffer getdents64 fills on each call
+#define COMPLETION_DENTS_BUFFER_SIZE (64 * 1024)
+
+// Columns of a candidate listing are this many cells apart at least
+#define COMPLETION_COLUMN_GAP 2
+
+// One node per distinct prefix. A node's children are stored next to each other sorted by character,
+// and the names starting with its prefix are names[lo, hi), so candidates never need a walk of the subtree
+typedef struct trie_node
+{
+    uint32_t first_child;
+    uint32_t lo;
+    uint32_t hi;
+    uint16_t num_children;
+    char c;
+} trie_node;
+
+// Every command name that can be completed: the executables in the PATH directories and the builtins.
+// The directories and their mtimes as they were when it was built tell when it's out of date
+typedef struct command_trie
+{
+    trie_node* nodes;
+    size_t num_nodes;
+    size_t capacity;
+
+    char** names; // Sorted, no duplicates
+    size_t num_names;
+    arena strings;
+
+    char** dirs;
+    struct timespec* dir_mtimes;
+    size_t num_dirs;
+
+    // The directories, opened on the shell's thread before the build, -1 for those that couldn't be.
+    // The builder closes them
+    int* dir_fds;
+} command_trie;
+
+// Names in one directory, sorted, with a '/' after those of directories. Valid as long as the directory's
+// mtime is the same
+typedef struct dir_listing
+{
+    char* dir;
+    int dir_fd; // Opened on the shell's thread before the scan, which closes it. -1 if it couldn't be
+    struct timespec mtime;
+    char** names;
+    size_t num_names;
+    size_t capacity;
+    arena strings;
+    uint64_t last_used;
+} dir_listing;
+
+void completion_start(const s_vector* paths, const char* const* builtins, size_t num_builtins);
+const command_trie* completion_commands(const s_vector* paths, const char* const* builtins, size_t num_builtins);
+bool completion_building();
+size_t trie_find(const command_trie* trie, const char* prefix, size_t length, size_t* first);
+const dir_listing* completion_directory(const char* dir);
+bool completion_collect();
+int completion_wake_fd();
+size_t listing_find(const dir_listing* listing, const char* prefix, size_t length, size_t* first);
+size_t common_prefix_length(char* const* names, size_t num_names);
+size_t completion_columns(char* const* names, size_t num_names, int width, int max_rows, char** out, size_t* out_capacity);
+void completion_free();
+
+#endif
@@ -3,6 +3,10 @@
 
 #define UNUSED(x) (void)(x)
 
+// How long to wait for the terminal to report the cursor position. Terminals that don't
+// answer at all cost this much once, instead of hanging the shell
+#define CURSOR_QUERY_TIMEOUT_MS 250
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -11,6 +15,11 @@
 #include <sys/ioctl.h>
 #include <signal.h>
 #include <assert.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
 
 typedef struct cursor_pos
 {
@@ -18,10 +27,13 @@ typedef struct cursor_pos
     int y;
 } cursor_pos;
 
-void move_cursor(int y, int x);
-cursor_pos get_cursor();
+extern bool cursor_column_known;
+
+bool query_cursor(cursor_pos* pos, int timeout_ms);
+size_t take_pending_input(char* buf, size_t size);
 void init_term_settings();
 void set_term_echo_and_canonical(bool enable);
+void set_bracketed_paste(bool enable);
 void recalculate_window_dimensions(int signum);
 void initscr();
 int win_size_x(void);
@@ -0,0 +1,59 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "s_vector.h"
+
+// Most candidates a search returns
+#define FUZZY_MAX_RESULTS 10
+// Queries this short match most of a big history. Their search stops after the newest
+// FUZZY_SHORT_QUERY_MATCHES matches, which is where recency puts the best candidates anyway
+#define FUZZY_SHORT_QUERY 2
+#define FUZZY_SHORT_QUERY_MATCHES 16384
+
+// What a search needs to know about one entry, computed once when the entry is indexed
+typedef struct fuzzy_entry
+{
+    const char* lower; // Lowercase copy of the entry
+    uint64_t mask;     // Bit of every character class present, see char_bit
+    uint32_t length;
+} fuzzy_entry;
+
+typedef struct fuzzy_result
+{
+    size_t index;
+    int score;
+} fuzzy_result;
+
+// Per entry search data for a string vector, kept in step with it like trigram_index
+typedef struct fuzzy_index
+{
+    fuzzy_entry* entries;
+    size_t size;
+    size_t capacity;
+
+    arena strings; // The lowercase copies
+
+    // Entries that matched the previous query, newest first. A query extending it only has to look at these,
+    // and at the entries below unscanned that a short query's search didn't get to
+    uint32_t* matches;
+    size_t num_matches;
+    size_t matches_capacity;
+    size_t unscanned;
+    char* last_query;
+    size_t last_query_size; // Number of entries when the matches were collected
+} fuzzy_index;
+
+void fuzzy_index_update(fuzzy_index* index, const s_vector* entries);
+bool fuzzy_index_step(fuzzy_index* index, const s_vector* entries, size_t max_entries);
+size_t fuzzy_search(fuzzy_index* index, const s_vector* entries, const uint32_t* uses, const char* query, fuzzy_result* results, size_t max_results);
+void fuzzy_index_free(fuzzy_index* index);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include <pwd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "s_vector.h"
+#include "trigram.h"
+#include "fuzzy.h"
+#include "redirect.h"
+
+// On disk, the history is the magic followed by records appended one write at a time:
+//     uint32_t length | int64_t timestamp | length bytes of text | '\0'
+// The terminator lets entries be used straight out of the mapped file
+#define HISTORY_MAGIC "RASHHST1"
+#define HISTORY_MAGIC_SIZE 8
+#define HISTORY_HEADER_SIZE (sizeof(uint32_t) + sizeof(int64_t))
+#define HISTORY_FILE_NAME ".rash_history"
+// Environment variable overriding the history file location
+#define HISTORY_FILE_ENV "RASH_HISTORY"
+// Whole records in a row that have to follow a point in damaged bytes for reading to pick up there
+#define HISTORY_RESYNC_RECORDS 4
+// Records kept by an offline compaction
+#define HISTORY_COMPACT_MAX 1000000
+// Entries left by moved lines before the history is compacted in memory
+#define HISTORY_MIN_REMOVED 1024
+// Entries deduped or indexed by one call to history_idle, about a millisecond of work. A key typed
+// meanwhile waits for the step to finish, so this bounds the latency idle work adds
+#define HISTORY_IDLE_STEP 4096
+
+typedef struct history_record
+{
+    const char* text;
+    uint32_t length;
+    int64_t timestamp;
+} history_record;
+
+char* history_file_path();
+void history_load(s_vector* history);
+void history_update(s_vector* history);
+void history_add(s_vector* history, const char* line);
+ssize_t history_search(s_vector* history, ssize_t current_index, const char* needle);
+bool history_idle(s_vector* history);
+size_t history_fuzzy_search(s_vector* history, const char* query, fuzzy_result* results, size_t max_results);
+bool history_is_mapped(const char* entry);
+void history_free(s_vector* history);
+int history_compact(const char* path);
+
+#endif
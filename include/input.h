@@ -0,0 +1,83 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+
+#include "cursor.h"
+
+// How long an escape sequence split across reads gets to complete before a lone escape counts as the Escape key
+#define INPUT_ESCAPE_TIMEOUT_MS 25
+
+typedef enum
+{
+    KEY_UNASSIGNED,
+    KEY_ALPHA_NUM_SYMBOL,
+    KEY_ENTER,
+
+    KEY_BACKSPACE,
+    KEY_C_BACKSPACE,
+    KEY_DELETE,
+
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_DOWN,
+    KEY_UP,
+
+    KEY_C_LEFT,
+    KEY_C_RIGHT,
+    KEY_C_UP,
+    KEY_C_DOWN,
+
+    KEY_C_AT,
+    KEY_C_A,
+    KEY_C_B,
+    KEY_C_C,
+    KEY_C_D,
+    KEY_C_E,
+    KEY_C_F,
+    KEY_C_G,
+    KEY_C_H,
+    KEY_C_I,
+    KEY_C_J,
+    KEY_C_K,
+    KEY_C_L,
+    KEY_C_M,
+    KEY_C_N,
+    KEY_C_O,
+    KEY_C_P,
+    KEY_C_Q,
+    KEY_C_R,
+    KEY_C_S,
+    KEY_C_T,
+    KEY_C_U,
+    KEY_C_V,
+    KEY_C_W,
+    KEY_C_X,
+    KEY_C_Y,
+    KEY_C_Z,
+    KEY_C_LBRACKET,
+    KEY_C_BACKSLASH,
+    KEY_C_RBRACKET,
+    KEY_C_CARET,
+    KEY_C_UNDERSCORE,
+
+    KEY_ESCAPE,
+    KEY_PASTE, // A bracketed paste, the text is in input_paste
+
+} KEY;
+
+bool is_alpha_numeric_symbolic(char c);
+bool input_fill(const sigset_t* wait_mask, int wake_fd, bool (*idle)());
+bool input_next(KEY* key, char* c);
+const char* input_paste(size_t* size);
+void input_free();
+
+#endif
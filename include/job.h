@@ -0,0 +1,76 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "cursor.h"
+
+typedef enum job_state
+{
+    JOB_RUNNING,
+    JOB_STOPPED,
+    JOB_DONE,
+} job_state;
+
+typedef struct process
+{
+    pid_t pid;
+    int status;
+    bool completed;
+    bool stopped;
+    struct rusage usage; // Filled in once it's completed
+} process;
+
+// One pipeline started by the shell, along with the state of each of its stages
+typedef struct job
+{
+    int id;
+    pid_t pgid;
+    process* procs;
+    size_t num_procs;
+    job_state state;
+    char* text;
+    bool notified; // Whether the user has been told about the current state
+} job;
+
+typedef struct job_table
+{
+    job** data;
+    size_t size;
+    size_t capacity;
+} job_table;
+
+extern job_table jobs;
+extern pid_t shell_pgid;
+extern bool job_control;
+extern pid_t active_child;
+extern volatile sig_atomic_t child_status_changed;
+extern struct rusage last_job_usage;
+
+void init_job_control(bool interactive);
+job* job_add(pid_t pgid, const pid_t* pids, size_t num_procs, char* text);
+void job_remove(job* j);
+job* job_find(const char* spec);
+bool update_process(pid_t pid, int status, const struct rusage* usage);
+bool job_reap();
+void job_wait(job* j);
+int job_foreground(job* j, bool cont);
+void job_background(job* j);
+void job_notify();
+int job_exit_status(const job* j);
+void job_usage(const job* j, struct rusage* usage);
+void print_job(const job* j);
+void free_jobs();
+
+#endif
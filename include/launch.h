@@ -0,0 +1,59 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+
+// Process launch backend. posix_spawn is the default, build with 'make spawn=fork'
+// to go back to fork+execv for comparison
+#ifdef RASH_LAUNCH_FORK
+#define LAUNCH_BACKEND "fork"
+#else
+#define LAUNCH_BACKEND "posix_spawn"
+#endif
+
+#define LAUNCH_MAX_ACTIONS 16
+
+typedef enum launch_action_type
+{
+    LAUNCH_OPEN,
+    LAUNCH_DUP2,
+    LAUNCH_CLOSE,
+} launch_action_type;
+
+// One file descriptor operation, applied in order in the child before exec
+typedef struct launch_action
+{
+    launch_action_type type;
+    int fd;
+    int src_fd;
+    const char* path;
+    int flags;
+    mode_t mode;
+} launch_action;
+
+typedef struct launch_spec
+{
+    const char* path;
+    char* const* argv;
+    launch_action actions[LAUNCH_MAX_ACTIONS];
+    size_t num_actions;
+    bool overflowed; // An action didn't fit, launch refuses to start the child
+    bool set_pgid; // Move the child to process group pgid, 0 starts a new group led by the child
+    pid_t pgid;
+    bool foreground; // Make the child's process group the terminal's foreground group before exec
+} launch_spec;
+
+bool launch_add_open(launch_spec* spec, int fd, const char* path, int flags, mode_t mode);
+bool launch_add_dup2(launch_spec* spec, int src_fd, int fd);
+bool launch_add_close(launch_spec* spec, int fd);
+pid_t launch(const launch_spec* spec);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "arena.h"
+#include "s_vector.h"
+
+typedef enum DELIM
+{
+    ALPHANUMERIC,
+    WHITESPACE,
+    PIPE,
+    OUT_REDIR,
+    IN_REDIR,
+    SEMI_COLON,
+    AMPERSAND,
+    QUOTE,
+    DOUBLE_QUOTE,
+} DELIM;
+
+// A view into the input buffer. Words have kind ALPHANUMERIC, operators the kind of their character.
+// A word that is a single quoted string points inside the quotes. A word mixing quoted and unquoted
+// parts spans all of them, quotes included, and is only copied (without the quotes) when it's used
+typedef struct token
+{
+    size_t offset;
+    size_t length;
+    DELIM kind;
+    bool needs_copy;
+    char saved; // Byte overwritten by the terminator while the line runs
+} token;
+
+typedef struct token_vector
+{
+    token* data;
+    size_t size;
+    size_t capacity;
+} token_vector;
+
+extern const char* const delim_strings[];
+
+DELIM delimiter(char c);
+const char* lexer_set_simd(bool enable);
+bool tokenize(arena* a, token_vector* tokens, char* buffer, ssize_t nread);
+void terminate_tokens(arena* a, token_vector* tokens, char* buffer, s_vector* words);
+void restore_tokens(const token_vector* tokens, char* buffer);
+
+#endif
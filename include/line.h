@@ -10,24 +10,38 @@
 
 extern size_t min_size;
 
+// Gap buffer. The text is data[0, gap) followed by data[gap_end, capacity), where
+// gap_end = gap + capacity - size. Edits move the gap to the cursor first, so typing or deleting
+// at the same spot costs O(1) however long the line is, and moving the cursor costs nothing.
+// capacity is always larger than size, so the text can be terminated in place.
+//
+// A line can also show text it doesn't own (line_show), which is only copied into data once edited
 typedef struct line
 {
     char* data;
     size_t size;
     size_t capacity;
     size_t cursor_pos;
+    size_t gap;
+    const char* borrowed;
 } line;
 
 void initialize_line(line* l);
 // warning: assumes previous l->data was handled properly by
 // either clearing+free or moving l->data somewhere else
 void initialize_line_with_new_data(line* l, char* d);
+void line_show(line* l, const char* text);
 void increase_line_capacity(line * l);
 void insert_character(line* l, char c);
+void line_insert(line* l, const char* text, size_t length);
 void push_back_character(line* l, char c);
 bool remove_character(line* l);
+void line_delete_range(line* l, size_t start, size_t end);
 void clear_line(line* l);
 void clear_line_and_free(line* l);
 void move_line_cursor_x(line* l, int x);
+char line_char_at(const line* l, size_t i);
+char* line_c_str(line* l);
+void line_segments(const line* l, const char** first, size_t* first_size, const char** second, size_t* second_size);
 
 #endif
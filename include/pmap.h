@@ -0,0 +1,52 @@
+#ifndef PMAP_H
+#define PMAP_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+
+// Read size for items coming from stdin
+#define PMAP_READ_SIZE 4096
+// Exit status when more jobs than this failed, the way GNU parallel reports it
+#define PMAP_MAX_FAILED_STATUS 101
+
+#define PMAP_PLACEHOLDER "{}"
+// Most jobs run at a time whatever -j asks for, RLIMIT_NPROC can lower it
+#define PMAP_MAX_JOBS 1024
+
+// A running child. With grouped output, what it writes is kept in out_fd and err_fd until it's done
+typedef struct pmap_slot
+{
+    pid_t pid;
+    int out_fd;
+    int err_fd;
+} pmap_slot;
+
+// Where the items come from: the arguments after ':::', or else stdin one line at a time
+typedef struct pmap_items
+{
+    char** args;
+    int num_args;
+    int next;
+
+    bool from_stdin;
+    char* buffer; // buffer[start, size) hasn't been handed out yet
+    size_t start;
+    size_t size;
+    size_t capacity;
+    bool eof;
+} pmap_items;
+
+int pmap(int argc, char** argv);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "launch.h"
+
+// Highest descriptor a redirection can name, a single digit like POSIX requires
+#define REDIR_MAX_FD 9
+// The shell's own descriptors, and those saved while a builtin's redirections are in place, are kept
+// at least this high, out of reach of 3>file or <&3
+#define REDIR_SHELL_FD_MIN (REDIR_MAX_FD + 1)
+// Saved in place of a descriptor that wasn't open, restoring closes it again
+#define REDIR_WAS_CLOSED -2
+
+typedef enum redir_type
+{
+    REDIR_READ,       // n<file
+    REDIR_WRITE,      // n>file
+    REDIR_APPEND,     // n>>file
+    REDIR_READ_WRITE, // n<>file
+    REDIR_DUP,        // n>&m and n<&m
+    REDIR_CLOSE,      // n>&- and n<&-
+    REDIR_HEREDOC,    // n<<word, the lines that follow up to word
+    REDIR_HERESTRING, // n<<<word, word and a newline
+} redir_type;
+
+// One redirection of a command. They're applied left to right, so 2>&1 >file and >file 2>&1 differ
+typedef struct redirection
+{
+    redir_type type;
+    int fd;
+    const char* target; // File name, or the text of a here-document or here-string
+    int target_fd;      // Descriptor REDIR_DUP copies
+} redirection;
+
+// The shell's descriptors a builtin's redirections replaced, -1 for those left alone
+typedef struct saved_fds
+{
+    int fds[REDIR_MAX_FD + 1];
+} saved_fds;
+
+int redirect_hide_fd(int fd);
+size_t redirect_parse(arena* a, const char* op, const char* word, redirection* redirs);
+bool redirects_fd(const redirection* redirs, size_t num_redirs, int fd);
+bool redirect_fits(size_t num_other, size_t num_redirs);
+bool redirect_spawn(launch_spec* spec, const redirection* redirs, size_t num_redirs, int* fds, size_t* num_fds);
+void redirect_close(int* fds, size_t num_fds);
+void redirect_replace_fd(int file, int fd, int* saved);
+bool redirect_shell(const redirection* redirs, size_t num_redirs, saved_fds* saved);
+void redirect_restore(saved_fds* saved);
+
+#endif
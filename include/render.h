@@ -0,0 +1,47 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "line.h"
+#include "cursor.h"
+
+// Wrap every update in the synchronized update mode (DEC 2026), so terminals that support it
+// show the whole update at once. Others ignore the sequences
+#define RENDER_SYNCHRONIZED_UPDATE 1
+
+// What is on the screen from the prompt down, as the renderer last drew it. Positions are cells
+// counted from the start of the prompt's row, so the renderer only ever moves relative to where it
+// left the cursor and never needs to know the absolute row
+typedef struct frame
+{
+    char* prompt;
+    size_t prompt_width;  // Visible width of the prompt, escape sequences excluded
+    size_t prompt_column; // Column the prompt started at
+
+    char* text; // The line
+    size_t size;
+    size_t capacity;
+
+    char* footer; // Rows drawn under the line, separated by '\n'
+    size_t footer_size;
+    size_t footer_capacity;
+
+    size_t cursor; // Cell the terminal cursor is on
+    int width;     // Terminal width the frame was drawn for
+    bool drawn;    // A prompt is on the screen
+} frame;
+
+void render_prompt(const char* prompt, size_t prompt_width, size_t column);
+void render_line(const line* l, const char* footer, size_t footer_size);
+void render_end_line();
+void render_flush();
+
+#endif
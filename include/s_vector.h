@@ -15,7 +15,6 @@ typedef struct s_vector
 } s_vector;
 
 void add_string(s_vector* lines, char* buffer, bool copy);
-void buf_add_string(s_vector* lines, char* buffer, ssize_t nread);
 void erase(s_vector* vec, int pos);
 void free_s_vector(s_vector* vector);
 
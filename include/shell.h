@@ -19,53 +19,95 @@
 #include <fcntl.h>
 #include <termios.h>
 #include <sys/ioctl.h>
+#include <poll.h>
+
+#define SCRIPT_CHUNK_SIZE (64 * 1024)
 
 #include "s_vector.h"
+#include "lexer.h"
 #include "line.h"
 #include "cursor.h"
+#include "command_hash.h"
+#include "launch.h"
+#include "job.h"
+#include "history.h"
+#include "render.h"
+#include "input.h"
+#include "completion.h"
+#include "stats.h"
+#include "builtin.h"
+#include "redirect.h"
+#include "pmap.h"
 
 typedef struct command
 {
     size_t args_start;
     size_t args_end;
-    char* stdin_redir;
-    char* stdout_redir;
-    char* stderr_redir;
+    redirection* redirs; // In the order they're written, applied left to right
+    size_t num_redirs;
     struct command* pipe; // Piped command
     bool bg; // Foreground or background cmd
 
 } command;
 
+// Hands out the line of input after the one being run, valid until the next call, NULL when there are no more
+typedef char* (*line_reader)(size_t* length);
+
 void add_string(s_vector* lines, char* buffer, bool copy);
-void buf_add_string(s_vector* lines, char* buffer, ssize_t nread);
 void erase(s_vector* vec, int pos);
 void add_path(s_vector*, char* path_name);
+const char* resolve_executable(char* name);
+char* command_text(const command* command, s_vector* tokens);
 void execute_bin(const command* command, s_vector* tokens);
 int num_args(const command* command);
 int file_status(char* path_name);
 int count_digits(int n);
-ssize_t find_index_of_next_string_match(s_vector* haystack, ssize_t current_index, char* needle, bool search_backwards);
 void kill_child(int sig_num);
 
-void cd(const command* command, s_vector* tokens);
-void prevd(const command* command);
-void nextd(const command* command);
-void dirh(const command* command);
-void path(const command* command, s_vector* tokens);
+int cd(int argc, char** argv);
+int prevd(int argc, char** argv);
+int nextd(int argc, char** argv);
+int dirh(int argc, char** argv);
+int path(int argc, char** argv);
+int hash(int argc, char** argv);
+int jobs_builtin(int argc, char** argv);
+int fg(int argc, char** argv);
+int bg(int argc, char** argv);
+int wait_builtin(int argc, char** argv);
+void time_builtin(const command* command, s_vector* tokens);
+int rashstat(int argc, char** argv);
+void print_usage(long elapsed_ns, const struct rusage* usage);
 
 void clear_screen();
 void delete_word_backwards(line* l);
 void remove_character_forward(line* l);
+void insert_paste(line* l);
+void complete_line(line* l);
 void backward_history_search();
 void forward_history_search();
+void start_reverse_search();
+void update_reverse_search();
+void end_reverse_search(bool accept);
+void handle_reverse_search_key(int key_type, char c);
+void refresh_reverse_search();
+void refresh_interactive_line();
+void handle_input();
+void handle_key(KEY key_type, char c);
+
+int exit_builtin(int argc, char** argv);
 
 void handle_command(const command* command, s_vector* args);
-void print_prompt();
-void refresh_prompt(bool flush);
-void read_line(char** buffer, size_t* size, ssize_t* nread);
+void run_command(const command* command, s_vector* args);
+bool parse_commands(token_vector* tokens, char* buffer, s_vector* words, command** commands, size_t* num_commands);
+bool parse_tokens(token_vector* tokens, char* buffer);
+bool execute_line(char* buffer, size_t length);
+const char* build_prompt(size_t* width);
+void refresh_prompt();
 void init(int argc, char* argv[]);
+void run_script(const char* file_name);
 void run();
 
+extern arena line_arena;
 extern line interactive_line;
 extern s_vector paths;
 
@@ -77,10 +119,10 @@ extern bool search_initiated;
 extern s_vector dir_history;
 extern size_t current_dir;
 
-extern size_t prompt_start_y;
-extern size_t prompt_end_y;
-extern size_t prompt_length;
 
-extern pid_t active_child;
+extern line_reader heredoc_input;
+extern int last_status;
+extern long time_threshold_ms;
+extern bool interactive;
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+// Every power of two of nanoseconds is split into this many buckets, so percentiles are within 25%
+#define STATS_SUB_BUCKETS 4
+#define STATS_BUCKETS (64 * STATS_SUB_BUCKETS)
+
+typedef enum stat_id
+{
+    STAT_KEYSTROKE, // Keys read to line repainted
+    STAT_TOKENIZE,
+    STAT_PARSE,
+    STAT_RESOLVE,   // Looking a command up in PATH
+    STAT_SPAWN,     // Starting a process until it runs the new program
+    STAT_RUN,       // A foreground job's processes started until they're done
+    STAT_COUNT,
+} stat_id;
+
+// Log-linear latency histogram, along with the exact count, total and extremes
+typedef struct latency_histogram
+{
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[STATS_BUCKETS];
+} latency_histogram;
+
+extern latency_histogram stats[STAT_COUNT];
+
+uint64_t stats_now();
+void stats_record(stat_id id, uint64_t ns);
+void stats_record_since(stat_id id, uint64_t start_ns);
+uint64_t stats_percentile(const latency_histogram* h, double percentile);
+void stats_print(FILE* out);
+void stats_print_json(FILE* out);
+void stats_reset();
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "s_vector.h"
+
+// Sorted ids of the entries containing one trigram
+typedef struct posting_list
+{
+    uint32_t trigram; // The three bytes, 0 marks an empty slot
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t* ids;
+} posting_list;
+
+// Inverted index from every trigram to the entries of a string vector containing it.
+// Entries are indexed in order, so every posting list stays sorted without any work.
+// num_indexed entries are covered, a search checks the rest directly
+typedef struct trigram_index
+{
+    posting_list* lists;
+    size_t size;
+    size_t capacity;
+
+    size_t num_indexed;
+} trigram_index;
+
+void trigram_index_add(trigram_index* index, const char* text);
+bool trigram_index_update(trigram_index* index, const s_vector* entries, size_t max_entries);
+ssize_t trigram_index_find(trigram_index* index, const s_vector* entries, ssize_t current_index, const char* needle);
+void trigram_index_free(trigram_index* index);
+
+#endif
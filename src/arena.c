@@ -0,0 +1,81 @@
+#include "../include/arena.h"
+
+static size_t arena_alignment = sizeof(void*);
+
+static arena_block* new_block(arena* a, size_t min_size)
+{
+    size_t capacity = a->head ? a->head->capacity << 1 : ARENA_MIN_BLOCK_SIZE;
+    while (capacity < min_size) { capacity <<= 1; }
+
+    arena_block* block = malloc(sizeof(*block) + capacity);
+    if (!block)
+    {
+        perror("arena malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    block->next = a->head;
+    block->capacity = capacity;
+    block->used = 0;
+
+    a->head = block;
+
+    return block;
+}
+
+// Returns size bytes aligned for any pointer sized member. Never fails
+void* arena_alloc(arena* a, size_t size)
+{
+    arena_block* block = a->head;
+    size_t offset = block ? (block->used + arena_alignment - 1) & ~(arena_alignment - 1) : 0;
+
+    if (!block || offset + size > block->capacity)
+    {
+        block = new_block(a, size);
+        offset = 0;
+    }
+
+    block->used = offset + size;
+
+    return block->data + offset;
+}
+
+void* arena_calloc(arena* a, size_t count, size_t size)
+{
+    void* memory = arena_alloc(a, count * size);
+    memset(memory, 0, count * size);
+    return memory;
+}
+
+char* arena_strndup(arena* a, const char* s, size_t n)
+{
+    char* copy = arena_alloc(a, n + 1);
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+// Releases everything allocated from the arena. Only the newest block is kept, which after the
+// first few lines is the only block there is, so this is constant time
+void arena_reset(arena* a)
+{
+    if (!a->head) { return; }
+
+    arena_block* block = a->head->next;
+    while (block)
+    {
+        arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    a->head->next = NULL;
+    a->head->used = 0;
+}
+
+void arena_free(arena* a)
+{
+    arena_reset(a);
+    free(a->head);
+    a->head = NULL;
+}
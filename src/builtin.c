@@ -0,0 +1,753 @@
+#include "../include/shell.h"
+
+extern char** environ;
+
+bool builtin_line_open = false;
+
+static int echo_builtin(int argc, char** argv);
+static int printf_builtin(int argc, char** argv);
+static int test_builtin(int argc, char** argv);
+static int bracket_builtin(int argc, char** argv);
+static int pwd_builtin(int argc, char** argv);
+static int true_builtin(int argc, char** argv);
+static int false_builtin(int argc, char** argv);
+static int type_builtin(int argc, char** argv);
+static int export_builtin(int argc, char** argv);
+
+// Commands run in the shell itself. The ones that change the shell's state live next to that state
+static const builtin builtins[] =
+{
+    { "exit", exit_builtin },
+    { "cd", cd },
+    { "prevd", prevd },
+    { "nextd", nextd },
+    { "dirh", dirh },
+    { "path", path },
+    { "hash", hash },
+    { "jobs", jobs_builtin },
+    { "fg", fg },
+    { "bg", bg },
+    { "wait", wait_builtin },
+    { "rashstat", rashstat },
+    { "pmap", pmap },
+    { "echo", echo_builtin },
+    { "printf", printf_builtin },
+    { "test", test_builtin },
+    { "[", bracket_builtin },
+    { "pwd", pwd_builtin },
+    { "true", true_builtin },
+    { "false", false_builtin },
+    { "type", type_builtin },
+    { "export", export_builtin },
+};
+
+#define NUM_BUILTINS (sizeof(builtins) / sizeof(*builtins))
+
+// Words handle_command looks for before any lookup, since they take a whole command rather than arguments
+static const char* const keywords[] = { "time" };
+
+#define NUM_KEYWORDS (sizeof(keywords) / sizeof(*keywords))
+
+const char* builtin_names[NUM_BUILTINS + NUM_KEYWORDS];
+const size_t num_builtin_names = NUM_BUILTINS + NUM_KEYWORDS;
+
+// Open addressing over the builtins, filled once by builtin_init
+static const builtin* table[BUILTIN_TABLE_SIZE];
+
+// FNV-1a
+static size_t hash_name(const char* s)
+{
+    size_t h = 14695981039346656037ULL;
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void builtin_init()
+{
+    for (size_t i = 0; i < NUM_BUILTINS; i++)
+    {
+        size_t slot = hash_name(builtins[i].name) & (BUILTIN_TABLE_SIZE - 1);
+        while (table[slot]) { slot = (slot + 1) & (BUILTIN_TABLE_SIZE - 1); }
+
+        table[slot] = &builtins[i];
+        builtin_names[i] = builtins[i].name;
+    }
+
+    for (size_t i = 0; i < NUM_KEYWORDS; i++)
+        builtin_names[NUM_BUILTINS + i] = keywords[i];
+}
+
+// Returns the builtin called name, NULL if it's not one
+const builtin* builtin_find(const char* name)
+{
+    size_t slot = hash_name(name) & (BUILTIN_TABLE_SIZE - 1);
+
+    for (const builtin* b; (b = table[slot]); slot = (slot + 1) & (BUILTIN_TABLE_SIZE - 1))
+    {
+        if (!strcmp(b->name, name))
+            return b;
+    }
+
+    return NULL;
+}
+
+bool is_keyword(const char* name)
+{
+    for (size_t i = 0; i < NUM_KEYWORDS; i++)
+    {
+        if (!strcmp(keywords[i], name))
+            return true;
+    }
+
+    return false;
+}
+
+// Output of echo and printf, which can leave the cursor in the middle of a row
+static void out(const char* s, size_t n)
+{
+    if (!n) { return; }
+
+    fwrite(s, 1, n, stdout);
+    builtin_line_open = s[n - 1] != '\n';
+}
+
+// Decodes the backslash escape after s[-1] into *c, returning where the text continues. In echo and %b
+// an octal escape starts with \0, in a printf format it doesn't. NULL means \c: no more output
+static const char* escape(const char* s, char* c, bool zero_octal)
+{
+    switch (*s)
+    {
+        case 'a': *c = '\a'; return s + 1;
+        case 'b': *c = '\b'; return s + 1;
+        case 'e': *c = '\033'; return s + 1;
+        case 'f': *c = '\f'; return s + 1;
+        case 'n': *c = '\n'; return s + 1;
+        case 'r': *c = '\r'; return s + 1;
+        case 't': *c = '\t'; return s + 1;
+        case 'v': *c = '\v'; return s + 1;
+        case '\\': *c = '\\'; return s + 1;
+        case 'c': return NULL;
+        case 'x':
+            if (isxdigit((unsigned char)s[1]))
+            {
+                int value = 0, digits = 0;
+                for (s++; digits < 2 && isxdigit((unsigned char)*s); s++, digits++)
+                    value = value * 16 + (isdigit((unsigned char)*s) ? *s - '0' : tolower((unsigned char)*s) - 'a' + 10);
+
+                *c = (char)value;
+                return s;
+            }
+            break;
+        default:
+            if (zero_octal ? *s == '0' : (*s >= '0' && *s <= '7'))
+            {
+                int value = 0, digits = 0;
+                if (zero_octal) { s++; }
+                for (; digits < 3 && *s >= '0' && *s <= '7'; s++, digits++)
+                    value = value * 8 + *s - '0';
+
+                *c = (char)value;
+                return s;
+            }
+            break;
+    }
+
+    // Not an escape, the backslash stays
+    *c = '\\';
+    return s;
+}
+
+// Writes s with its escapes decoded, returning false if it ended with \c
+static bool out_escaped(const char* s, bool zero_octal)
+{
+    while (*s)
+    {
+        const char* backslash = strchr(s, '\\');
+        if (!backslash)
+        {
+            out(s, strlen(s));
+            break;
+        }
+
+        out(s, (size_t)(backslash - s));
+
+        char c;
+        s = escape(backslash + 1, &c, zero_octal);
+        if (!s) { return false; }
+        out(&c, 1);
+    }
+
+    return true;
+}
+
+// echo built-in. -n leaves out the line break, -e decodes backslash escapes and -E doesn't
+static int echo_builtin(int argc, char** argv)
+{
+    bool newline = true;
+    bool escapes = false;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        // Only arguments made of option letters alone are options, anything else is printed
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1)) { break; }
+
+        for (const char* o = argv[i] + 1; *o; o++)
+        {
+            if (*o == 'n') { newline = false; }
+            else { escapes = *o == 'e'; }
+        }
+    }
+
+    for (; i < argc; i++)
+    {
+        if (escapes)
+        {
+            if (!out_escaped(argv[i], true)) { return 0; }
+        }
+        else
+        {
+            out(argv[i], strlen(argv[i]));
+        }
+
+        if (i + 1 < argc) { out(" ", 1); }
+    }
+
+    if (newline) { out("\n", 1); }
+
+    return 0;
+}
+
+// Numeric argument of a printf conversion. A leading quote gives the character's value.
+// Sets *ok to false and reports it if arg isn't a number
+static long long printf_integer(const char* arg, bool* ok)
+{
+    if (!arg) { return 0; }
+    if (*arg == '\'' || *arg == '"') { return (unsigned char)arg[1]; }
+
+    errno = 0;
+    char* end;
+    long long value = strtoll(arg, &end, 0);
+
+    // Unsigned conversions of large values wrap like the C ones do
+    if (errno == ERANGE && *arg != '-')
+    {
+        errno = 0;
+        value = (long long)strtoull(arg, &end, 0);
+    }
+
+    if (end == arg || *end || errno)
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *ok = false;
+    }
+
+    return value;
+}
+
+static double printf_double(const char* arg, bool* ok)
+{
+    if (!arg) { return 0; }
+    if (*arg == '\'' || *arg == '"') { return (unsigned char)arg[1]; }
+
+    char* end;
+    double value = strtod(arg, &end);
+    if (end == arg || *end)
+    {
+        fprintf(stderr, "printf: %s: invalid number\n", arg);
+        *ok = false;
+    }
+
+    return value;
+}
+
+// Formats one conversion with the C printf, spec being everything from '%' but the conversion character
+static void printf_conversion(const char* spec, size_t spec_length, char conversion, const char* arg, bool* ok)
+{
+    // The spec, a length modifier, the conversion and the terminator
+    char format[PRINTF_MAX_SPEC + 3];
+    char* text = NULL;
+    int n = -1;
+
+    switch (conversion)
+    {
+        case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+            snprintf(format, sizeof(format), "%.*sll%c", (int)spec_length, spec, conversion);
+            n = asprintf(&text, format, printf_integer(arg, ok));
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            snprintf(format, sizeof(format), "%.*s%c", (int)spec_length, spec, conversion);
+            n = asprintf(&text, format, printf_double(arg, ok));
+            break;
+        case 'c':
+            // An empty argument has no character to print, only the padding
+            snprintf(format, sizeof(format), "%.*s%c", (int)spec_length, spec, arg && *arg ? 'c' : 's');
+            n = arg && *arg ? asprintf(&text, format, *arg) : asprintf(&text, format, "");
+            break;
+        default:
+            snprintf(format, sizeof(format), "%.*ss", (int)spec_length, spec);
+            n = asprintf(&text, format, arg ? arg : "");
+            break;
+    }
+
+    if (n == -1)
+    {
+        perror("asprintf");
+        exit(EXIT_FAILURE);
+    }
+
+    out(text, (size_t)n);
+    free(text);
+}
+
+// printf built-in. Formats the arguments like printf(3), plus %b for a string with escapes.
+// The format is used again as long as arguments are left, missing ones count as empty or 0
+static int printf_builtin(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    const char* format = argv[1];
+    int next = 2;
+    bool ok = true;
+
+    do
+    {
+        int first = next;
+
+        for (const char* f = format; *f; )
+        {
+            if (*f == '\\')
+            {
+                char c;
+                f = escape(f + 1, &c, false);
+                if (!f) { return ok ? 0 : 1; }
+                out(&c, 1);
+                continue;
+            }
+
+            if (*f != '%')
+            {
+                size_t n = strcspn(f, "\\%");
+                out(f, n);
+                f += n;
+                continue;
+            }
+
+            if (f[1] == '%')
+            {
+                out("%", 1);
+                f += 2;
+                continue;
+            }
+
+            const char* spec = f;
+            f++;
+            f += strspn(f, "-+ #0");
+            f += strspn(f, "0123456789");
+            if (*f == '.')
+            {
+                f++;
+                f += strspn(f, "0123456789");
+            }
+
+            char conversion = *f;
+            if (!conversion || !strchr("diouxXeEfFgGaAcsb", conversion) || (size_t)(f - spec) >= PRINTF_MAX_SPEC)
+            {
+                fprintf(stderr, "printf: %.*s: invalid format\n", (int)(f - spec + (conversion != '\0')), spec);
+                return 1;
+            }
+
+            const char* arg = next < argc ? argv[next++] : NULL;
+
+            if (conversion == 'b')
+            {
+                if (arg && !out_escaped(arg, true)) { return ok ? 0 : 1; }
+            }
+            else
+            {
+                printf_conversion(spec, (size_t)(f - spec), conversion, arg, &ok);
+            }
+
+            f++;
+        }
+
+        // A format without conversions would otherwise never use the arguments up
+        if (next == first) { break; }
+    } while (next < argc);
+
+    return ok ? 0 : 1;
+}
+
+// test and [ take apart their arguments with this recursive descent parser:
+//     or := and ('-o' and)*    and := not ('-a' not)*    not := '!' not | primary
+//     primary := '(' or ')' | unary-op arg | arg binary-op arg | arg
+typedef struct test_parser
+{
+    char** argv;
+    int argc;
+    int pos;
+    bool error;
+} test_parser;
+
+static bool test_or(test_parser* p);
+
+static bool is_unary_test(const char* op)
+{
+    return op[0] == '-' && op[1] && !op[2] && strchr("bcdefghkLnprsStuwxzGO", op[1]);
+}
+
+static bool is_binary_test(const char* op)
+{
+    static const char* const ops[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef" };
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(*ops); i++)
+    {
+        if (!strcmp(ops[i], op))
+            return true;
+    }
+
+    return false;
+}
+
+static long long test_integer(test_parser* p, const char* arg)
+{
+    char* end;
+    errno = 0;
+    long long value = strtoll(arg, &end, 10);
+
+    while (isspace((unsigned char)*end)) { end++; }
+    if (end == arg || *end || errno)
+    {
+        fprintf(stderr, "test: %s: integer expression expected\n", arg);
+        p->error = true;
+    }
+
+    return value;
+}
+
+static bool test_unary(test_parser* p, char op, const char* arg)
+{
+    if (op == 'n') { return *arg; }
+    if (op == 'z') { return !*arg; }
+    if (op == 't') { return isatty((int)test_integer(p, arg)); }
+
+    struct stat s;
+    if ((op == 'h' || op == 'L' ? lstat(arg, &s) : stat(arg, &s)) == -1) { return false; }
+
+    switch (op)
+    {
+        case 'b': return S_ISBLK(s.st_mode);
+        case 'c': return S_ISCHR(s.st_mode);
+        case 'd': return S_ISDIR(s.st_mode);
+        case 'e': return true;
+        case 'f': return S_ISREG(s.st_mode);
+        case 'g': return s.st_mode & S_ISGID;
+        case 'h': case 'L': return S_ISLNK(s.st_mode);
+        case 'k': return s.st_mode & S_ISVTX;
+        case 'p': return S_ISFIFO(s.st_mode);
+        case 'r': return !access(arg, R_OK);
+        case 's': return s.st_size > 0;
+        case 'S': return S_ISSOCK(s.st_mode);
+        case 'u': return s.st_mode & S_ISUID;
+        case 'w': return !access(arg, W_OK);
+        case 'x': return !access(arg, X_OK);
+        case 'G': return s.st_gid == getegid();
+        case 'O': return s.st_uid == geteuid();
+        default: return false;
+    }
+}
+
+static bool newer(const struct stat* a, const struct stat* b)
+{
+    return a->st_mtim.tv_sec > b->st_mtim.tv_sec || (a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec > b->st_mtim.tv_nsec);
+}
+
+static bool test_binary(test_parser* p, const char* left, const char* op, const char* right)
+{
+    if (!strcmp(op, "=") || !strcmp(op, "==")) { return !strcmp(left, right); }
+    if (!strcmp(op, "!=")) { return strcmp(left, right); }
+    if (!strcmp(op, "<")) { return strcmp(left, right) < 0; }
+    if (!strcmp(op, ">")) { return strcmp(left, right) > 0; }
+
+    if (!strcmp(op, "-nt") || !strcmp(op, "-ot") || !strcmp(op, "-ef"))
+    {
+        struct stat l, r;
+        bool has_left = stat(left, &l) == 0, has_right = stat(right, &r) == 0;
+
+        if (!strcmp(op, "-ef")) { return has_left && has_right && l.st_dev == r.st_dev && l.st_ino == r.st_ino; }
+        if (!strcmp(op, "-nt")) { return has_left && (!has_right || newer(&l, &r)); }
+        return has_right && (!has_left || newer(&r, &l));
+    }
+
+    long long a = test_integer(p, left), b = test_integer(p, right);
+
+    if (!strcmp(op, "-eq")) { return a == b; }
+    if (!strcmp(op, "-ne")) { return a != b; }
+    if (!strcmp(op, "-lt")) { return a < b; }
+    if (!strcmp(op, "-le")) { return a <= b; }
+    if (!strcmp(op, "-gt")) { return a > b; }
+    return a >= b;
+}
+
+static bool test_primary(test_parser* p)
+{
+    if (p->pos >= p->argc)
+    {
+        fprintf(stderr, "test: argument expected\n");
+        p->error = true;
+        return false;
+    }
+
+    char** argv = p->argv + p->pos;
+    int left = p->argc - p->pos;
+
+    // A binary operator in second place wins, so '[ ( = ( ]' and '[ -n = -n ]' compare strings
+    if (left >= 3 && is_binary_test(argv[1]))
+    {
+        p->pos += 3;
+        return test_binary(p, argv[0], argv[1], argv[2]);
+    }
+
+    if (!strcmp(argv[0], "(") && left >= 2)
+    {
+        p->pos++;
+        bool value = test_or(p);
+
+        if (p->pos >= p->argc || strcmp(p->argv[p->pos], ")"))
+        {
+            fprintf(stderr, "test: ')' expected\n");
+            p->error = true;
+            return false;
+        }
+
+        p->pos++;
+        return value;
+    }
+
+    if (left >= 2 && is_unary_test(argv[0]))
+    {
+        p->pos += 2;
+        return test_unary(p, argv[0][1], argv[1]);
+    }
+
+    // A lone word is true when it's not empty
+    p->pos++;
+    return *argv[0];
+}
+
+static bool test_not(test_parser* p)
+{
+    if (p->pos + 1 < p->argc && !strcmp(p->argv[p->pos], "!"))
+    {
+        p->pos++;
+        return !test_not(p);
+    }
+
+    return test_primary(p);
+}
+
+static bool test_and(test_parser* p)
+{
+    bool value = test_not(p);
+
+    while (!p->error && p->pos + 1 < p->argc && !strcmp(p->argv[p->pos], "-a"))
+    {
+        p->pos++;
+        // Both sides are parsed either way, so a syntax error on the right is still caught
+        bool right = test_not(p);
+        value = value && right;
+    }
+
+    return value;
+}
+
+static bool test_or(test_parser* p)
+{
+    bool value = test_and(p);
+
+    while (!p->error && p->pos + 1 < p->argc && !strcmp(p->argv[p->pos], "-o"))
+    {
+        p->pos++;
+        bool right = test_and(p);
+        value = value || right;
+    }
+
+    return value;
+}
+
+// test built-in. Exits with 0 when the expression is true, 1 when it's false and 2 when it's malformed
+static int test_builtin(int argc, char** argv)
+{
+    // No expression is false
+    if (argc < 2) { return 1; }
+
+    test_parser p = { argv + 1, argc - 1, 0, false };
+    bool value = test_or(&p);
+
+    if (!p.error && p.pos < p.argc)
+    {
+        fprintf(stderr, "test: %s: unexpected argument\n", p.argv[p.pos]);
+        p.error = true;
+    }
+
+    return p.error ? 2 : !value;
+}
+
+// [ built-in, test with a closing ']'
+static int bracket_builtin(int argc, char** argv)
+{
+    if (strcmp(argv[argc - 1], "]"))
+    {
+        fprintf(stderr, "[: missing ']'\n");
+        return 2;
+    }
+
+    return test_builtin(argc - 1, argv);
+}
+
+// pwd built-in. Prints the working directory
+static int pwd_builtin(int argc, char** argv)
+{
+    UNUSED(argc);
+    UNUSED(argv);
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        perror("pwd");
+        return 1;
+    }
+
+    printf("%s\n", cwd);
+    return 0;
+}
+
+static int true_builtin(int argc, char** argv)
+{
+    UNUSED(argc);
+    UNUSED(argv);
+    return 0;
+}
+
+static int false_builtin(int argc, char** argv)
+{
+    UNUSED(argc);
+    UNUSED(argv);
+    return 1;
+}
+
+// type built-in. Tells what running each name would run: a keyword, a builtin, or an executable
+static int type_builtin(int argc, char** argv)
+{
+    int status = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* name = argv[i];
+        const char* path;
+
+        if (is_keyword(name))
+            printf("%s is a shell keyword\n", name);
+        else if (builtin_find(name))
+            printf("%s is a shell builtin\n", name);
+        else
+        {
+            // Looked up the way execute_bin does
+            if (strchr(name, '/'))
+                path = is_executable_file(name) ? name : NULL;
+            else
+                path = hash_lookup(&cmd_hash, &paths, name);
+
+            if (path)
+            {
+                printf("%s is %s\n", name, path);
+            }
+            else
+            {
+                fprintf(stderr, "type: %s: not found\n", name);
+                status = 1;
+            }
+        }
+    }
+
+    return status;
+}
+
+static bool is_name(const char* s, size_t length)
+{
+    if (!length || isdigit((unsigned char)s[0])) { return false; }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (!isalnum((unsigned char)s[i]) && s[i] != '_')
+            return false;
+    }
+
+    return true;
+}
+
+// Prints an environment entry so it can be read back in, the value single-quoted
+static void print_export(const char* entry)
+{
+    const char* equals = strchr(entry, '=');
+    if (!equals) { return; }
+
+    printf("export %.*s='", (int)(equals - entry), entry);
+    for (const char* c = equals + 1; *c; c++)
+    {
+        if (*c == '\'')
+            fputs("'\\''", stdout);
+        else
+            putchar(*c);
+    }
+    fputs("'\n", stdout);
+}
+
+// export built-in. 'export NAME=value' sets NAME in the environment commands get. There are no shell
+// variables, so 'export NAME' only checks the name. Without arguments, prints the environment
+static int export_builtin(int argc, char** argv)
+{
+    if (argc == 1 || (argc == 2 && !strcmp(argv[1], "-p")))
+    {
+        for (char** entry = environ; *entry; entry++)
+            print_export(*entry);
+
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        char* equals = strchr(argv[i], '=');
+        size_t length = equals ? (size_t)(equals - argv[i]) : strlen(argv[i]);
+
+        if (!is_name(argv[i], length))
+        {
+            fprintf(stderr, "export: %s: not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+
+        if (!equals) { continue; }
+
+        *equals = '\0';
+        int err = setenv(argv[i], equals + 1, 1);
+        *equals = '=';
+
+        if (err == -1)
+        {
+            perror("export");
+            status = 1;
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,199 @@
+#include "../include/command_hash.h"
+
+command_hash cmd_hash = {0};
+
+static size_t min_hash_capacity = 64;
+
+// FNV-1a
+static size_t hash_string(const char* s)
+{
+    size_t h = 14695981039346656037ULL;
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Returns the slot holding name, or the empty slot where it should be inserted
+static hash_entry* find_slot(hash_entry* entries, size_t capacity, const char* name)
+{
+    size_t i = hash_string(name) & (capacity - 1);
+
+    while (entries[i].name && strcmp(entries[i].name, name))
+    {
+        i = (i + 1) & (capacity - 1);
+    }
+
+    return &entries[i];
+}
+
+static void grow_table(command_hash* table)
+{
+    size_t new_capacity = table->capacity ? table->capacity << 1 : min_hash_capacity;
+    hash_entry* new_entries = calloc(new_capacity, sizeof(*new_entries));
+    if (!new_entries)
+    {
+        perror("hash calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->entries[i].name)
+            *find_slot(new_entries, new_capacity, table->entries[i].name) = table->entries[i];
+    }
+
+    free(table->entries);
+    table->entries = new_entries;
+    table->capacity = new_capacity;
+}
+
+static long elapsed_ms(const struct timespec* start, const struct timespec* end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000 + (end->tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static bool same_mtime(const struct timespec* a, const struct timespec* b)
+{
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+// Regular file that the shell is allowed to execute
+bool is_executable_file(const char* path_name)
+{
+    struct stat s;
+    if (stat(path_name, &s) == -1) { return false; }
+
+    return S_ISREG(s.st_mode) && !access(path_name, X_OK);
+}
+
+// Drops every entry if a PATH directory was added, removed, or had its mtime change since the last check.
+// Unless force is set, the directories are only stat'ed once per HASH_RECHECK_INTERVAL_MS.
+// Returns true if the table was cleared
+bool hash_validate(command_hash* table, const s_vector* paths, bool force)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+    if (!force && table->num_dirs == paths->size && elapsed_ms(&table->last_check, &now) < HASH_RECHECK_INTERVAL_MS)
+        return false;
+
+    table->last_check = now;
+
+    bool changed = table->num_dirs != paths->size;
+    if (changed)
+    {
+        struct timespec* temp = realloc(table->dir_mtimes, sizeof(*temp) * (paths->size ? paths->size : 1));
+        if (!temp)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        table->dir_mtimes = temp;
+        table->num_dirs = paths->size;
+    }
+
+    for (size_t i = 0; i < paths->size; i++)
+    {
+        struct stat s;
+        struct timespec mtime = {0};
+        if (stat(paths->data[i], &s) == 0)
+            mtime = s.st_mtim;
+
+        if (changed || !same_mtime(&table->dir_mtimes[i], &mtime))
+        {
+            table->dir_mtimes[i] = mtime;
+            changed = true;
+        }
+    }
+
+    if (changed)
+        hash_clear(table);
+
+    return changed;
+}
+
+// Returns the absolute path of the executable name resolves to in paths, or NULL if there is none.
+// The returned string is owned by the table and stays valid until the next clear
+const char* hash_lookup(command_hash* table, const s_vector* paths, const char* name)
+{
+    hash_validate(table, paths, false);
+
+    if (table->capacity)
+    {
+        hash_entry* entry = find_slot(table->entries, table->capacity, name);
+        if (entry->name)
+        {
+            entry->hits++;
+            return entry->path;
+        }
+    }
+
+    char candidate[PATH_MAX];
+    for (size_t i = 0; i < paths->size; i++)
+    {
+        int length = snprintf(candidate, sizeof(candidate), "%s/%s", paths->data[i], name);
+        if (length < 0 || length >= (int)sizeof(candidate)) { continue; }
+
+        if (is_executable_file(candidate))
+        {
+            // Keep load factor under 1/2
+            if ((table->size + 1) * 2 > table->capacity) { grow_table(table); }
+
+            hash_entry* entry = find_slot(table->entries, table->capacity, name);
+            entry->name = strdup(name);
+            entry->path = strdup(candidate);
+            if (!entry->name || !entry->path)
+            {
+                perror("hash strdup");
+                exit(EXIT_FAILURE);
+            }
+            entry->hits = 1;
+            table->size++;
+
+            return entry->path;
+        }
+    }
+
+    return NULL;
+}
+
+void hash_clear(command_hash* table)
+{
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        free(table->entries[i].name);
+        free(table->entries[i].path);
+        table->entries[i].name = NULL;
+        table->entries[i].path = NULL;
+        table->entries[i].hits = 0;
+    }
+
+    table->size = 0;
+}
+
+void hash_free(command_hash* table)
+{
+    hash_clear(table);
+    free(table->entries);
+    free(table->dir_mtimes);
+    *table = (command_hash){0};
+}
+
+void hash_print(const command_hash* table)
+{
+    if (!table->size)
+    {
+        printf("hash: hash table empty\n");
+        return;
+    }
+
+    printf("hits\tcommand\n");
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->entries[i].name)
+            printf("%4lu\t%s\n", table->entries[i].hits, table->entries[i].path);
+    }
+}
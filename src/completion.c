@@ -0,0 +1,724 @@
+#include "../include/completion.h"
+
+#include <stdatomic.h>
+
+// The trie completions come from, and the one being built to replace it. Only the shell's thread
+// touches these, the builder only ever sees the trie it's given
+static command_trie* current = NULL;
+static command_trie* pending = NULL;
+static pthread_t builder;
+static bool building = false;
+
+// Set before a build starts and left alone until it's joined
+static const char* const* build_builtins = NULL;
+static size_t build_num_builtins = 0;
+
+// Path completion reads one directory at a time on the scanner thread. The listing joins the cache
+// once the shell collects it, after the scanner wrote to the wake pipe
+static dir_listing* cache[COMPLETION_CACHE_SIZE];
+static uint64_t cache_clock = 0;
+
+static dir_listing* scanning = NULL;
+static pthread_t scanner;
+static bool scanner_running = false;
+static char* next_scan = NULL; // Asked for while another directory was being read
+static int wake_pipe[2] = { -1, -1 };
+
+// Set by the builder and the scanner right before they write to the wake pipe, so the shell knows which
+// of them is done. Joining it then doesn't wait
+static atomic_bool build_done = false;
+static atomic_bool scan_done = false;
+
+// What getdents64 fills its buffer with
+typedef struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} linux_dirent64;
+
+static void* checked_realloc(void* data, size_t size)
+{
+    void* temp = realloc(data, size);
+    if (!temp)
+    {
+        perror("completion realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    return temp;
+}
+
+static bool same_mtime(const struct timespec* a, const struct timespec* b)
+{
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static void add_name(command_trie* trie, size_t* capacity, const char* name)
+{
+    if (trie->num_names == *capacity)
+    {
+        *capacity = *capacity ? *capacity << 1 : 1024;
+        trie->names = checked_realloc(trie->names, sizeof(*trie->names) * *capacity);
+    }
+
+    trie->names[trie->num_names++] = arena_strndup(&trie->strings, name, strlen(name));
+}
+
+// Opens dir for a worker thread to read. Called on the shell's thread, the only one a builtin's redirections
+// run on, so moving the descriptor next to the shell's own can't race with one of them
+static int open_directory(const char* dir)
+{
+    return redirect_hide_fd(open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+}
+
+// Adds every executable in the directory dir_fd refers to, closing it. Entries whose type readdir already
+// gives are only checked with access
+static void add_directory(command_trie* trie, size_t* capacity, int dir_fd)
+{
+    if (dir_fd == -1) { return; }
+
+    DIR* d = fdopendir(dir_fd);
+    if (!d)
+    {
+        close(dir_fd);
+        return;
+    }
+
+    int fd = dirfd(d);
+    struct dirent* entry;
+    while ((entry = readdir(d)))
+    {
+        if (entry->d_name[0] == '.') { continue; }
+
+        if (entry->d_type != DT_REG)
+        {
+            if (entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) { continue; }
+
+            struct stat s;
+            if (fstatat(fd, entry->d_name, &s, 0) == -1 || !S_ISREG(s.st_mode)) { continue; }
+        }
+
+        if (faccessat(fd, entry->d_name, X_OK, 0) == -1) { continue; }
+
+        add_name(trie, capacity, entry->d_name);
+    }
+
+    closedir(d);
+}
+
+static int compare_names(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static uint32_t new_nodes(command_trie* trie, size_t count)
+{
+    if (trie->num_nodes + count > trie->capacity)
+    {
+        while (trie->num_nodes + count > trie->capacity)
+            trie->capacity = trie->capacity ? trie->capacity << 1 : 1024;
+        trie->nodes = checked_realloc(trie->nodes, sizeof(*trie->nodes) * trie->capacity);
+    }
+
+    uint32_t first = (uint32_t)trie->num_nodes;
+    memset(trie->nodes + first, 0, sizeof(*trie->nodes) * count);
+    trie->num_nodes += count;
+
+    return first;
+}
+
+// Gives the node for the prefix of length depth its children, one per distinct next character
+static void build_children(command_trie* trie, uint32_t node, size_t depth)
+{
+    uint32_t lo = trie->nodes[node].lo;
+    uint32_t hi = trie->nodes[node].hi;
+
+    // The name equal to the prefix itself sorts first and has no next character
+    if (lo < hi && trie->names[lo][depth] == '\0') { lo++; }
+    if (lo == hi) { return; }
+
+    size_t num_children = 1;
+    for (uint32_t i = lo + 1; i < hi; i++)
+    {
+        if (trie->names[i][depth] != trie->names[i - 1][depth])
+            num_children++;
+    }
+
+    uint32_t first = new_nodes(trie, num_children);
+    trie->nodes[node].first_child = first;
+    trie->nodes[node].num_children = (uint16_t)num_children;
+
+    uint32_t child = first;
+    uint32_t start = lo;
+    for (uint32_t i = lo + 1; i <= hi; i++)
+    {
+        if (i < hi && trie->names[i][depth] == trie->names[start][depth]) { continue; }
+
+        trie->nodes[child].c = trie->names[start][depth];
+        trie->nodes[child].lo = start;
+        trie->nodes[child].hi = i;
+        child++;
+        start = i;
+    }
+
+    for (uint32_t i = 0; i < num_children; i++)
+        build_children(trie, first + i, depth + 1);
+}
+
+// Reads the directories the trie was set up with and builds it. Runs on the builder thread
+static void* build(void* arg)
+{
+    command_trie* trie = arg;
+    size_t capacity = 0;
+
+    // Taken before reading, so changes made while reading still make the trie out of date
+    for (size_t i = 0; i < trie->num_dirs; i++)
+    {
+        struct stat s;
+        if (trie->dir_fds[i] != -1 && fstat(trie->dir_fds[i], &s) == 0)
+            trie->dir_mtimes[i] = s.st_mtim;
+    }
+
+    for (size_t i = 0; i < trie->num_dirs; i++)
+        add_directory(trie, &capacity, trie->dir_fds[i]);
+
+    for (size_t i = 0; i < build_num_builtins; i++)
+        add_name(trie, &capacity, build_builtins[i]);
+
+    if (trie->num_names)
+        qsort(trie->names, trie->num_names, sizeof(*trie->names), compare_names);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < trie->num_names; i++)
+    {
+        if (!unique || strcmp(trie->names[unique - 1], trie->names[i]))
+            trie->names[unique++] = trie->names[i];
+    }
+    trie->num_names = unique;
+
+    uint32_t root = new_nodes(trie, 1);
+    trie->nodes[root].lo = 0;
+    trie->nodes[root].hi = (uint32_t)trie->num_names;
+    build_children(trie, root, 0);
+
+    atomic_store(&build_done, true);
+    if (write(wake_pipe[1], "", 1) == -1) { /* The pipe is full, so the shell is being woken anyway */ }
+
+    return NULL;
+}
+
+static void trie_free(command_trie* trie)
+{
+    if (!trie) { return; }
+
+    for (size_t i = 0; i < trie->num_dirs; i++)
+        free(trie->dirs[i]);
+    free(trie->dirs);
+    free(trie->dir_mtimes);
+    free(trie->dir_fds);
+    free(trie->nodes);
+    free(trie->names);
+    arena_free(&trie->strings);
+    free(trie);
+}
+
+// Switches to the trie being built once the builder is done with it. Waits for it if wait is set, otherwise
+// returns false while it's still building. Returns true if there's a new trie
+static bool finish_build(bool wait)
+{
+    if (!building || (!wait && !atomic_load(&build_done))) { return false; }
+
+    pthread_join(builder, NULL);
+    building = false;
+    atomic_store(&build_done, false);
+
+    trie_free(current);
+    current = pending;
+    pending = NULL;
+    return true;
+}
+
+// Starts building a new trie from paths and the builtins on a thread of its own. builtins has to stay valid
+// until the build is done. Completion keeps using the previous trie in the meantime. If a build is already
+// running, its trie is found out of date once it's in and rebuilt then
+void completion_start(const s_vector* paths, const char* const* builtins, size_t num_builtins)
+{
+    finish_build(false);
+    if (building) { return; }
+
+    completion_wake_fd();
+
+    pending = calloc(1, sizeof(*pending));
+    if (!pending)
+    {
+        perror("completion calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    pending->num_dirs = paths->size;
+    pending->dirs = checked_realloc(NULL, sizeof(*pending->dirs) * (paths->size ? paths->size : 1));
+    pending->dir_mtimes = calloc(paths->size ? paths->size : 1, sizeof(*pending->dir_mtimes));
+    if (!pending->dir_mtimes)
+    {
+        perror("completion calloc");
+        exit(EXIT_FAILURE);
+    }
+    pending->dir_fds = checked_realloc(NULL, sizeof(*pending->dir_fds) * (paths->size ? paths->size : 1));
+    for (size_t i = 0; i < paths->size; i++)
+    {
+        pending->dirs[i] = strdup(paths->data[i]);
+        if (!pending->dirs[i])
+        {
+            perror("strdup");
+            exit(EXIT_FAILURE);
+        }
+        pending->dir_fds[i] = open_directory(paths->data[i]);
+    }
+
+    build_builtins = builtins;
+    build_num_builtins = num_builtins;
+
+    // Every signal stays with the shell's thread, the builder inherits a mask blocking all of them
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int err = pthread_create(&builder, NULL, build, pending);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (err)
+    {
+        // Completion still works, it just costs the wait now
+        build(pending);
+        atomic_store(&build_done, false);
+        trie_free(current);
+        current = pending;
+        pending = NULL;
+        return;
+    }
+
+    building = true;
+}
+
+// Whether PATH or any of its directories changed since trie was built
+static bool out_of_date(const command_trie* trie, const s_vector* paths)
+{
+    if (trie->num_dirs != paths->size) { return true; }
+
+    for (size_t i = 0; i < paths->size; i++)
+    {
+        if (strcmp(trie->dirs[i], paths->data[i])) { return true; }
+
+        struct stat s;
+        struct timespec mtime = {0};
+        if (stat(paths->data[i], &s) == 0)
+            mtime = s.st_mtim;
+
+        if (!same_mtime(&trie->dir_mtimes[i], &mtime)) { return true; }
+    }
+
+    return false;
+}
+
+// Returns the trie of the commands in paths and the builtins without waiting for one. When it's out of date,
+// a new one is built in the background and the old one served meanwhile. NULL until the first build is in,
+// completion_collect tells when that is
+const command_trie* completion_commands(const s_vector* paths, const char* const* builtins, size_t num_builtins)
+{
+    finish_build(false);
+
+    if (!building && (!current || out_of_date(current, paths)))
+        completion_start(paths, builtins, num_builtins);
+
+    return current;
+}
+
+// Whether a new trie is on its way, completion_collect tells when it's in
+bool completion_building()
+{
+    return building;
+}
+
+// Finds the names starting with the first length bytes of prefix in O(length). They are names[first, first + count),
+// and count is returned
+size_t trie_find(const command_trie* trie, const char* prefix, size_t length, size_t* first)
+{
+    if (!trie->num_nodes) { return 0; }
+
+    const trie_node* node = &trie->nodes[0];
+    for (size_t i = 0; i < length; i++)
+    {
+        // Children are sorted by character
+        size_t lo = 0, hi = node->num_children;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            if ((unsigned char)trie->nodes[node->first_child + mid].c < (unsigned char)prefix[i])
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        if (lo == node->num_children || trie->nodes[node->first_child + lo].c != prefix[i]) { return 0; }
+
+        node = &trie->nodes[node->first_child + lo];
+    }
+
+    *first = node->lo;
+    return node->hi - node->lo;
+}
+
+static void add_listing_name(dir_listing* listing, const char* name, bool is_dir)
+{
+    if (listing->num_names == listing->capacity)
+    {
+        listing->capacity = listing->capacity ? listing->capacity << 1 : 256;
+        listing->names = checked_realloc(listing->names, sizeof(*listing->names) * listing->capacity);
+    }
+
+    size_t length = strlen(name);
+    char* copy = arena_alloc(&listing->strings, length + 2);
+    memcpy(copy, name, length);
+    if (is_dir) { copy[length++] = '/'; }
+    copy[length] = '\0';
+
+    listing->names[listing->num_names++] = copy;
+}
+
+// Reads the listing's directory with getdents64, straight into the listing. Only names whose type the kernel
+// doesn't give cost a stat. Runs on the scanner thread, and wakes the shell when done
+static void* scan(void* arg)
+{
+    dir_listing* listing = arg;
+
+    int fd = listing->dir_fd;
+    if (fd != -1)
+    {
+        // Taken before reading, like the trie's
+        struct stat s;
+        if (fstat(fd, &s) == 0)
+            listing->mtime = s.st_mtim;
+
+        char* buffer = checked_realloc(NULL, COMPLETION_DENTS_BUFFER_SIZE);
+
+        long n;
+        while ((n = syscall(SYS_getdents64, fd, buffer, COMPLETION_DENTS_BUFFER_SIZE)) > 0)
+        {
+            for (long offset = 0; offset < n;)
+            {
+                const linux_dirent64* entry = (const linux_dirent64*)(buffer + offset);
+                offset += entry->d_reclen;
+
+                if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) { continue; }
+
+                bool is_dir = entry->d_type == DT_DIR;
+                if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+                {
+                    struct stat t;
+                    is_dir = fstatat(fd, entry->d_name, &t, 0) == 0 && S_ISDIR(t.st_mode);
+                }
+
+                add_listing_name(listing, entry->d_name, is_dir);
+            }
+        }
+
+        free(buffer);
+        close(fd);
+
+        if (listing->num_names)
+            qsort(listing->names, listing->num_names, sizeof(*listing->names), compare_names);
+    }
+
+    atomic_store(&scan_done, true);
+    if (write(wake_pipe[1], "", 1) == -1) { /* The pipe is full, so the shell is being woken anyway */ }
+
+    return NULL;
+}
+
+static void listing_free(dir_listing* listing)
+{
+    if (!listing) { return; }
+
+    free(listing->dir);
+    free(listing->names);
+    arena_free(&listing->strings);
+    free(listing);
+}
+
+// The read end of the pipe the scanner writes to once a listing is ready, for the shell to wait on along with its input
+int completion_wake_fd()
+{
+    if (wake_pipe[0] == -1)
+    {
+        if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+        {
+            perror("pipe2");
+            exit(EXIT_FAILURE);
+        }
+
+        // O_NONBLOCK belongs to the pipe, not the descriptor, so the copies keep it
+        wake_pipe[0] = redirect_hide_fd(wake_pipe[0]);
+        wake_pipe[1] = redirect_hide_fd(wake_pipe[1]);
+    }
+
+    return wake_pipe[0];
+}
+
+static void start_scan(const char* dir)
+{
+    completion_wake_fd();
+
+    scanning = calloc(1, sizeof(*scanning));
+    if (!scanning)
+    {
+        perror("completion calloc");
+        exit(EXIT_FAILURE);
+    }
+    scanning->dir = strdup(dir);
+    if (!scanning->dir)
+    {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+    scanning->dir_fd = open_directory(dir);
+
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int err = pthread_create(&scanner, NULL, scan, scanning);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    // Read it right away instead, it's still collected the same way
+    if (err)
+        scan(scanning);
+
+    scanner_running = !err;
+}
+
+// Returns the listing of the absolute directory dir if one is cached and still up to date. Otherwise starts
+// reading it in the background and returns NULL, completion_collect tells when it's in
+const dir_listing* completion_directory(const char* dir)
+{
+    struct stat s;
+    if (stat(dir, &s) == -1) { return NULL; }
+
+    for (size_t i = 0; i < COMPLETION_CACHE_SIZE; i++)
+    {
+        if (cache[i] && !strcmp(cache[i]->dir, dir) && same_mtime(&cache[i]->mtime, &s.st_mtim))
+        {
+            cache[i]->last_used = ++cache_clock;
+            return cache[i];
+        }
+    }
+
+    if (!scanning)
+    {
+        start_scan(dir);
+    }
+    else if (strcmp(scanning->dir, dir))
+    {
+        free(next_scan);
+        next_scan = strdup(dir);
+    }
+
+    return NULL;
+}
+
+// Puts listing in the cache, in place of an older listing of the same directory or else the least recently used one
+static void cache_insert(dir_listing* listing)
+{
+    size_t slot = 0;
+    for (size_t i = 0; i < COMPLETION_CACHE_SIZE; i++)
+    {
+        if (cache[i] && !strcmp(cache[i]->dir, listing->dir))
+        {
+            slot = i;
+            break;
+        }
+
+        if (!cache[i] || (cache[slot] && cache[i]->last_used < cache[slot]->last_used))
+            slot = i;
+    }
+
+    listing_free(cache[slot]);
+    listing->last_used = ++cache_clock;
+    cache[slot] = listing;
+}
+
+// Takes in the trie the builder finished and the listing the scanner finished, if the wake pipe says there
+// is one, and starts on the directory asked for in the meantime. Never blocks. Returns true if either came in
+bool completion_collect()
+{
+    char drain[64];
+    bool woken = false;
+    while (wake_pipe[0] != -1 && read(wake_pipe[0], drain, sizeof(drain)) > 0) { woken = true; }
+
+    if (!woken) { return false; }
+
+    bool collected = finish_build(false);
+
+    if (!scanning || !atomic_load(&scan_done)) { return collected; }
+
+    // It already wrote its last byte
+    if (scanner_running)
+        pthread_join(scanner, NULL);
+    scanner_running = false;
+    atomic_store(&scan_done, false);
+
+    cache_insert(scanning);
+    scanning = NULL;
+
+    if (next_scan)
+    {
+        char* dir = next_scan;
+        next_scan = NULL;
+        start_scan(dir);
+        free(dir);
+    }
+
+    return true;
+}
+
+// Finds the names in listing starting with the first length bytes of prefix. They are names[first, first + count),
+// and count is returned
+size_t listing_find(const dir_listing* listing, const char* prefix, size_t length, size_t* first)
+{
+    size_t lo = 0, hi = listing->num_names;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (strncmp(listing->names[mid], prefix, length) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    size_t end = lo;
+    hi = listing->num_names;
+    while (end < hi)
+    {
+        size_t mid = (end + hi) / 2;
+        if (strncmp(listing->names[mid], prefix, length) <= 0)
+            end = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *first = lo;
+    return end - lo;
+}
+
+// Length of the prefix shared by all of names, which have to be sorted
+size_t common_prefix_length(char* const* names, size_t num_names)
+{
+    if (!num_names) { return 0; }
+
+    const char* a = names[0];
+    const char* b = names[num_names - 1];
+
+    size_t length = 0;
+    while (a[length] && a[length] == b[length]) { length++; }
+
+    return length;
+}
+
+// Lays names out in columns, going down each column first, in rows of less than width cells separated
+// by '\n'. At most max_rows rows are used, the last one saying how many names didn't fit.
+// Returns the size of the text written to *out, which is grown as needed
+size_t completion_columns(char* const* names, size_t num_names, int width, int max_rows, char** out, size_t* out_capacity)
+{
+    size_t usable = width > 1 ? (size_t)width - 1 : 1;
+    size_t rows_available = max_rows > 1 ? (size_t)max_rows : 1;
+
+    size_t longest = 0;
+    for (size_t i = 0; i < num_names; i++)
+    {
+        size_t length = strlen(names[i]);
+        if (length > longest) { longest = length; }
+    }
+
+    size_t column_width = longest + COMPLETION_COLUMN_GAP;
+    size_t columns = usable / column_width ? usable / column_width : 1;
+    size_t rows = (num_names + columns - 1) / columns;
+
+    size_t shown = num_names;
+    if (rows > rows_available)
+    {
+        rows = rows_available - 1;
+        shown = rows * columns;
+    }
+    if (shown < num_names && !rows)
+        shown = 0;
+
+    size_t needed = rows * (usable + 1) + 64;
+    if (needed > *out_capacity)
+    {
+        *out_capacity = needed;
+        *out = checked_realloc(*out, *out_capacity);
+    }
+
+    size_t size = 0;
+    for (size_t row = 0; row < rows; row++)
+    {
+        if (row) { (*out)[size++] = '\n'; }
+
+        size_t row_start = size;
+        for (size_t column = 0; column < columns; column++)
+        {
+            size_t i = column * rows + row;
+            if (i >= shown) { break; }
+
+            size_t length = strlen(names[i]);
+            if (length > usable - (size - row_start)) { length = usable - (size - row_start); }
+
+            memcpy(*out + size, names[i], length);
+            size += length;
+
+            // Pad up to the next column, unless this was the last one on the row
+            if (column + 1 < columns && (column + 1) * rows + row < shown)
+            {
+                size_t pad = column_width - length;
+                memset(*out + size, ' ', pad);
+                size += pad;
+            }
+        }
+    }
+
+    if (shown < num_names)
+        size += sprintf(*out + size, "%s(%lu more)", rows ? "\n" : "", num_names - shown);
+
+    return size;
+}
+
+void completion_free()
+{
+    finish_build(true);
+
+    trie_free(current);
+    current = NULL;
+
+    if (scanner_running)
+        pthread_join(scanner, NULL);
+    scanner_running = false;
+    atomic_store(&scan_done, false);
+    listing_free(scanning);
+    scanning = NULL;
+
+    for (size_t i = 0; i < COMPLETION_CACHE_SIZE; i++)
+    {
+        listing_free(cache[i]);
+        cache[i] = NULL;
+    }
+
+    free(next_scan);
+    next_scan = NULL;
+
+    if (wake_pipe[0] != -1)
+    {
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        wake_pipe[0] = wake_pipe[1] = -1;
+    }
+}
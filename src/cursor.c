@@ -6,52 +6,123 @@ struct termios term_settings;
 int win_size_x(void) { return win_size.ws_col; }
 int win_size_y(void) { return win_size.ws_row; }
 
-void move_cursor(int y, int x)
+// Input read while waiting for the terminal's reply, handed to the editor before anything else
+static char pending_input[256];
+static size_t pending_size = 0;
+
+// Whether the column the cursor is on is known without asking. Cleared when something else
+// had the terminal, since its output can end anywhere
+bool cursor_column_known = true;
+
+static void keep_input(const char* s, size_t n)
 {
-    assert(y > 0 && x > 0);
-    assert(y <= win_size_y() && x <= win_size_x());
+    if (n > sizeof(pending_input) - pending_size)
+        n = sizeof(pending_input) - pending_size;
 
-    printf("\033[%d;%dH", y, x);
+    memcpy(pending_input + pending_size, s, n);
+    pending_size += n;
 }
 
-cursor_pos get_cursor()
+// Moves up to size bytes of input read early into buf, returning how many
+size_t take_pending_input(char* buf, size_t size)
 {
-    // Write term code and get response
-    write(STDOUT_FILENO, "\033[6n", 4);
-    char answer[16] = {0};
-    int bytes_read = read(STDIN_FILENO, answer, 16);
-    if (bytes_read == -1)
-    {
-        perror("get_cursor read");
-        exit(EXIT_FAILURE);
-    }
+    size_t n = pending_size < size ? pending_size : size;
+
+    memcpy(buf, pending_input, n);
+    memmove(pending_input, pending_input + n, pending_size - n);
+    pending_size -= n;
+
+    return n;
+}
 
-    // Answer is in the form \e[y;xR
-    cursor_pos pos = {0};
-    bool found_x_delim = false;
-    bool found_y_delim = false;
-    for (int i = 2; i < 16; i++)
+// Finds a cursor position report (\e[y;xR) in s, returning its length and where it starts, or 0
+static size_t find_report(const char* s, size_t n, size_t* start, cursor_pos* pos)
+{
+    for (size_t i = 0; i + 1 < n; i++)
     {
-        if (!found_y_delim && answer[i] == ';')
+        if (s[i] != '\033' || s[i + 1] != '[') { continue; }
+
+        cursor_pos p = {0};
+        size_t j = i + 2;
+        bool found_y_delim = false;
+        for (; j < n && (isdigit((unsigned char)s[j]) || (s[j] == ';' && !found_y_delim)); j++)
         {
-            found_y_delim = true;
-            continue;
+            if (s[j] == ';')
+                found_y_delim = true;
+            else if (!found_y_delim)
+                p.y = p.y * 10 + s[j] - '0';
+            else
+                p.x = p.x * 10 + s[j] - '0';
         }
-            
-        if (answer[i] == 'R')
+
+        if (j < n && s[j] == 'R' && found_y_delim)
         {
-            found_x_delim = true;
-            break;
+            *start = i;
+            *pos = p;
+            return j + 1 - i;
         }
+    }
 
-        if (!found_y_delim)
-            pos.y = pos.y * 10 + answer[i] - '0';
+    return 0;
+}
+
+// Asks the terminal where the cursor is, waiting at most timeout_ms for the reply. Keys typed
+// in the meantime are kept for the editor. Returns false if no reply came
+bool query_cursor(cursor_pos* pos, int timeout_ms)
+{
+    if (write(STDOUT_FILENO, "\033[6n", 4) != 4) { return false; }
 
-        if (found_y_delim && !found_x_delim)
-            pos.x = pos.x * 10 + answer[i] - '0';
+    char answer[64];
+    size_t size = 0;
+
+    struct timespec now, deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (true)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long left = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000L;
+        if (left <= 0) { break; }
+
+        struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+        int ready = poll(&pfd, 1, (int)left);
+        if (ready == -1 && errno == EINTR) { continue; }
+        if (ready <= 0) { break; }
+
+        ssize_t n = read(STDIN_FILENO, answer + size, sizeof(answer) - size);
+        if (n == -1 && errno == EINTR) { continue; }
+        if (n <= 0) { break; }
+        size += n;
+
+        size_t start;
+        size_t length = find_report(answer, size, &start, pos);
+        if (length)
+        {
+            keep_input(answer, start);
+            keep_input(answer + start + length, size - start - length);
+            return true;
+        }
+
+        // Whatever can't be the start of the reply is typed input
+        size_t keep = size;
+        const char* escape = memrchr(answer, '\033', size);
+        if (escape) { keep = escape - answer; }
+        if (keep == 0 && size == sizeof(answer)) { keep = size; }
+
+        keep_input(answer, keep);
+        memmove(answer, answer + keep, size - keep);
+        size -= keep;
     }
 
-    return pos;
+    keep_input(answer, size);
+    return false;
 }
 
 // Initialize term settings, turning off echo and canonical mode
@@ -76,6 +147,15 @@ void init_canonical_term()
         perror("tcsetattr\n");
         exit(EXIT_FAILURE);
     }
+
+    set_bracketed_paste(true);
+}
+
+// Asks the terminal to mark pasted text, so a paste reaches the editor as one block instead of typed keys
+void set_bracketed_paste(bool enable)
+{
+    fputs(enable ? "\033[?2004h" : "\033[?2004l", stdout);
+    fflush(stdout);
 }
 
 void set_term_echo_and_canonical(bool enable)
@@ -97,6 +177,9 @@ void set_term_echo_and_canonical(bool enable)
         perror("tcsetattr\n");
         exit(EXIT_FAILURE);
     }
+
+    // Programs run from the shell get pastes as the terminal normally sends them
+    set_bracketed_paste(!enable);
 }
 
 void recalculate_window_dimensions(int signum)
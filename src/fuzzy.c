@@ -0,0 +1,240 @@
+#include "../include/fuzzy.h"
+
+// Score of each matched character and the extra for where it matched
+#define SCORE_MATCH 16
+#define SCORE_CONSECUTIVE 12
+#define SCORE_WORD_START 8
+#define SCORE_LINE_START 8
+#define PENALTY_GAP 1
+
+// Weight of how recent and how often used a line is, next to the match itself
+#define RECENCY_WEIGHT 2
+#define FREQUENCY_WEIGHT 4
+
+// Letters and digits get a bit each, everything else shares the remaining 28
+static int char_bit(unsigned char c)
+{
+    if (c >= 'a' && c <= 'z') { return c - 'a'; }
+    if (c >= '0' && c <= '9') { return 26 + c - '0'; }
+    return 36 + c % 28;
+}
+
+static uint64_t char_mask(const char* lower, size_t length)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < length; i++)
+        mask |= 1ULL << char_bit((unsigned char)lower[i]);
+    return mask;
+}
+
+// Number of bits needed to write n
+static int bit_length(size_t n)
+{
+    return n ? 64 - __builtin_clzll(n) : 0;
+}
+
+static void add_entry(fuzzy_index* index, const s_vector* entries)
+{
+    if (index->size == index->capacity)
+    {
+        index->capacity = index->capacity ? index->capacity << 1 : 1024;
+        fuzzy_entry* temp = realloc(index->entries, sizeof(*index->entries) * index->capacity);
+        if (!temp)
+        {
+            perror("fuzzy realloc");
+            exit(EXIT_FAILURE);
+        }
+        index->entries = temp;
+    }
+
+    size_t id = index->size++;
+    fuzzy_entry* e = &index->entries[id];
+    const char* text = entries->data[id];
+    memset(e, 0, sizeof(*e));
+
+    // Gone entries keep their slot so ids stay the same as in the vector
+    if (!text) { return; }
+
+    size_t length = strlen(text);
+    char* lower = arena_alloc(&index->strings, length + 1);
+    for (size_t i = 0; i <= length; i++)
+        lower[i] = (text[i] >= 'A' && text[i] <= 'Z') ? text[i] - 'A' + 'a' : text[i];
+
+    e->lower = lower;
+    e->length = (uint32_t)length;
+    e->mask = char_mask(lower, length);
+}
+
+// Indexes the entries added since the last update
+void fuzzy_index_update(fuzzy_index* index, const s_vector* entries)
+{
+    while (index->size < entries->size)
+        add_entry(index, entries);
+}
+
+// Indexes at most max_entries of the entries added since the last update, so a big history can be indexed
+// a bit at a time before the first search needs it. Returns true if there are more left
+bool fuzzy_index_step(fuzzy_index* index, const s_vector* entries, size_t max_entries)
+{
+    for (size_t i = 0; i < max_entries && index->size < entries->size; i++)
+        add_entry(index, entries);
+
+    return index->size < entries->size;
+}
+
+static bool is_word_start(const char* s, size_t i)
+{
+    return i == 0 || s[i - 1] == ' ' || s[i - 1] == '/' || s[i - 1] == '-' || s[i - 1] == '_' || s[i - 1] == '.';
+}
+
+// Scores query as a subsequence of s, -1 if it isn't one. The leftmost match is found going forward,
+// then tightened going backward from where it ended, so "gco" in "git checkout" scores the short span
+static int match_score(const char* s, size_t length, const char* query, size_t query_length)
+{
+    size_t q = 0;
+    size_t end = 0;
+    for (size_t i = 0; i < length && q < query_length; i++)
+    {
+        if (s[i] == query[q])
+        {
+            q++;
+            end = i + 1;
+        }
+    }
+    if (q < query_length) { return -1; }
+
+    size_t start = end;
+    while (q > 0)
+    {
+        start--;
+        if (s[start] == query[q - 1]) { q--; }
+    }
+
+    int score = start == 0 ? SCORE_LINE_START : 0;
+    bool previous_matched = false;
+
+    for (size_t i = start; i < end && q < query_length; i++)
+    {
+        if (s[i] == query[q])
+        {
+            score += SCORE_MATCH;
+            if (previous_matched) { score += SCORE_CONSECUTIVE; }
+            if (is_word_start(s, i)) { score += SCORE_WORD_START; }
+
+            previous_matched = true;
+            q++;
+        }
+        else
+        {
+            score -= PENALTY_GAP;
+            previous_matched = false;
+        }
+    }
+
+    return score;
+}
+
+// Keeps results sorted best first, dropping whatever falls past max_results
+static void add_result(fuzzy_result* results, size_t* num_results, size_t max_results, size_t id, int score)
+{
+    if (*num_results == max_results && score <= results[max_results - 1].score) { return; }
+
+    size_t i = *num_results < max_results ? (*num_results)++ : max_results - 1;
+    for (; i > 0 && results[i - 1].score < score; i--)
+        results[i] = results[i - 1];
+
+    results[i].index = id;
+    results[i].score = score;
+}
+
+static void add_match(fuzzy_index* index, uint32_t id)
+{
+    if (index->num_matches == index->matches_capacity)
+    {
+        index->matches_capacity = index->matches_capacity ? index->matches_capacity << 1 : 1024;
+        uint32_t* temp = realloc(index->matches, sizeof(*index->matches) * index->matches_capacity);
+        if (!temp)
+        {
+            perror("fuzzy realloc");
+            exit(EXIT_FAILURE);
+        }
+        index->matches = temp;
+    }
+
+    index->matches[index->num_matches++] = id;
+}
+
+// Fills results with the best max_results entries for query, best first, and returns how many there are.
+// Matching ignores case, and uses holds how often each entry was used, or is NULL. Only entries whose
+// character mask covers the query's are scored, and when query extends the previous one only the previous
+// matches are looked at, along with whatever a capped short query left unscanned
+size_t fuzzy_search(fuzzy_index* index, const s_vector* entries, const uint32_t* uses, const char* query, fuzzy_result* results, size_t max_results)
+{
+    fuzzy_index_update(index, entries);
+
+    size_t query_length = strlen(query);
+    char lower_query[query_length + 1];
+    for (size_t i = 0; i <= query_length; i++)
+        lower_query[i] = (query[i] >= 'A' && query[i] <= 'Z') ? query[i] - 'A' + 'a' : query[i];
+
+    uint64_t query_mask = char_mask(lower_query, query_length);
+
+    bool narrowing = index->last_query && index->last_query_size == index->size &&
+                     !strncmp(lower_query, index->last_query, strlen(index->last_query));
+
+    // The previous matches come first, then the entries below scan_from, newest first either way
+    size_t num_previous = narrowing ? index->num_matches : 0;
+    size_t scan_from = narrowing ? index->unscanned : index->size;
+    size_t num_candidates = num_previous + scan_from;
+    size_t max_matches = query_length <= FUZZY_SHORT_QUERY ? FUZZY_SHORT_QUERY_MATCHES : SIZE_MAX;
+    size_t num_results = 0;
+    size_t newest = index->size - 1;
+
+    // Collected in place, matches only ever shrink while narrowing
+    index->num_matches = 0;
+    index->unscanned = 0;
+
+    for (size_t k = 0; k < num_candidates; k++)
+    {
+        uint32_t id = k < num_previous ? index->matches[k] : (uint32_t)(scan_from - 1 - (k - num_previous));
+
+        // Every entry above id was looked at, a longer query has to look at the rest
+        if (index->num_matches == max_matches)
+        {
+            index->unscanned = id + 1;
+            break;
+        }
+
+        const fuzzy_entry* e = &index->entries[id];
+
+        // Entries can be removed from the vector after they were indexed
+        if (!e->lower || !entries->data[id]) { continue; }
+        if ((e->mask & query_mask) != query_mask || e->length < query_length) { continue; }
+
+        int score = match_score(e->lower, e->length, lower_query, query_length);
+        if (score < 0) { continue; }
+
+        add_match(index, id);
+
+        score += RECENCY_WEIGHT * (bit_length(index->size) - bit_length(newest - id + 1));
+        score += FREQUENCY_WEIGHT * bit_length(uses ? uses[id] : 1);
+
+        add_result(results, &num_results, max_results, id, score);
+    }
+
+    free(index->last_query);
+    index->last_query = strdup(lower_query);
+    index->last_query_size = index->size;
+
+    return num_results;
+}
+
+void fuzzy_index_free(fuzzy_index* index)
+{
+    free(index->entries);
+    arena_free(&index->strings);
+    free(index->matches);
+    free(index->last_query);
+
+    memset(index, 0, sizeof(*index));
+}
@@ -0,0 +1,600 @@
+#include "../include/history.h"
+
+// The history file as it was when the shell started. Entries loaded from it point into this mapping
+static char* history_map = NULL;
+static size_t history_map_size = 0;
+
+// Opened for appending, -1 if the history isn't persisted
+static int history_fd = -1;
+
+// Built a step at a time like the fuzzy index below, so loading never has to read the entries
+static trigram_index history_trigrams = {0};
+// Built a step at a time while the shell waits for input, see history_idle
+static fuzzy_index history_fuzzy = {0};
+
+// Open addressing table of entry index + 1 of every distinct line, 0 marks an empty slot.
+// A line entered again moves to the end of the history and leaves a NULL where it was.
+// Like the indexes above it only covers the first num_deduped entries, until history_idle or history_update
+static uint32_t* history_slots = NULL;
+static size_t history_slots_capacity = 0;
+static size_t history_num_lines = 0;
+static size_t history_num_deduped = 0;
+static size_t history_num_removed = 0;
+
+// How often and when each entry was last entered, parallel to the history
+static uint32_t* history_uses = NULL;
+static int64_t* history_last_used = NULL;
+static size_t history_meta_capacity = 0;
+
+static size_t min_slots_capacity = 1024;
+
+// Returns the malloc'd path of the history file, or NULL if there's no home directory
+char* history_file_path()
+{
+    char* path = NULL;
+
+    const char* override = getenv(HISTORY_FILE_ENV);
+    if (override && *override)
+        return strdup(override);
+
+    const char* home = getenv("HOME");
+    if (!home || !*home)
+    {
+        struct passwd* pw = getpwuid(getuid());
+        home = pw ? pw->pw_dir : NULL;
+    }
+
+    if (!home) { return NULL; }
+
+    if (asprintf(&path, "%s/%s", home, HISTORY_FILE_NAME) == -1)
+    {
+        perror("asprintf");
+        exit(EXIT_FAILURE);
+    }
+
+    return path;
+}
+
+// Reads the record at *offset. Returns false at the end of the data or at a torn record,
+// which can only be the last one since every record is written with a single write
+static bool next_record(const char* data, size_t size, size_t* offset, history_record* record)
+{
+    if (*offset + HISTORY_HEADER_SIZE > size) { return false; }
+
+    memcpy(&record->length, data + *offset, sizeof(record->length));
+    memcpy(&record->timestamp, data + *offset + sizeof(record->length), sizeof(record->timestamp));
+
+    size_t end = *offset + HISTORY_HEADER_SIZE + (size_t)record->length + 1;
+    if (end > size || end < *offset || data[end - 1] != '\0') { return false; }
+
+    record->text = data + *offset + HISTORY_HEADER_SIZE;
+    *offset = end;
+
+    return true;
+}
+
+// Offset of the first record past damaged bytes at offset, or size if there's none. A start is taken once
+// HISTORY_RESYNC_RECORDS whole records follow from it, or fewer that end the data, so each try is cheap and
+// any later damage is left for the next resync. A crash mid-write only tears the last record, but bytes
+// written into the file by anything else can be anywhere, with good records after them
+static size_t resync(const char* data, size_t size, size_t offset)
+{
+    for (size_t start = offset + 1; start + HISTORY_HEADER_SIZE < size; start++)
+    {
+        size_t end = start;
+        size_t num_records = 0;
+        history_record record;
+
+        while (num_records < HISTORY_RESYNC_RECORDS && next_record(data, size, &end, &record) &&
+               !memchr(record.text, '\0', record.length))
+        {
+            num_records++;
+            if (end == size) { return start; }
+        }
+
+        if (num_records == HISTORY_RESYNC_RECORDS) { return start; }
+    }
+
+    return size;
+}
+
+// next_record, stepping over damaged bytes. *damaged counts the bytes stepped over
+static bool next_intact_record(const char* data, size_t size, size_t* offset, history_record* record, size_t* damaged)
+{
+    while (*offset < size)
+    {
+        if (next_record(data, size, offset, record)) { return true; }
+
+        size_t next = resync(data, size, *offset);
+        *damaged += next - *offset;
+        *offset = next;
+    }
+
+    return false;
+}
+
+// Writes the magic and every intact record of data after the first skip to a new file that replaces path.
+// *kept is how many were written
+static bool write_records(const char* path, const char* data, size_t size, size_t skip, size_t* kept)
+{
+    char* temp_path = NULL;
+    if (asprintf(&temp_path, "%s.XXXXXX", path) == -1)
+    {
+        perror("asprintf");
+        exit(EXIT_FAILURE);
+    }
+
+    int temp_fd = mkstemp(temp_path);
+    FILE* out = temp_fd == -1 ? NULL : fdopen(temp_fd, "w");
+    if (!out)
+    {
+        perror("mkstemp");
+        free(temp_path);
+        return false;
+    }
+
+    fwrite(HISTORY_MAGIC, 1, HISTORY_MAGIC_SIZE, out);
+
+    *kept = 0;
+    size_t offset = HISTORY_MAGIC_SIZE;
+    size_t damaged = 0;
+    history_record record;
+    while (next_intact_record(data, size, &offset, &record, &damaged))
+    {
+        if (!record.length) { continue; }
+        if (skip) { skip--; continue; }
+
+        fwrite(record.text - HISTORY_HEADER_SIZE, 1, HISTORY_HEADER_SIZE + record.length + 1, out);
+        (*kept)++;
+    }
+
+    bool failed = fflush(out) || fsync(temp_fd);
+    fclose(out);
+
+    if (failed || rename(temp_path, path) == -1)
+    {
+        perror("history rewrite");
+        unlink(temp_path);
+        free(temp_path);
+        return false;
+    }
+
+    free(temp_path);
+    return true;
+}
+
+// Gets rid of damaged bytes found while loading, so records appended from now on can be read back.
+// A torn last record is cut off. Anything else means rewriting the file, which then gets appended to instead
+static void repair(const char* path, size_t intact_end, size_t damaged)
+{
+    fprintf(stderr, "%s: skipped %lu damaged bytes\n", path, damaged);
+
+    if (intact_end + damaged == history_map_size)
+    {
+        if (ftruncate(history_fd, intact_end) == -1)
+            perror("history ftruncate");
+        return;
+    }
+
+    size_t kept;
+    if (!write_records(path, history_map, history_map_size, 0, &kept)) { return; }
+
+    // Entries keep pointing into the mapping of the old file, which stays around until it's unmapped
+    close(history_fd);
+    history_fd = redirect_hide_fd(open(path, O_RDWR | O_APPEND | O_CLOEXEC));
+    if (history_fd == -1)
+        perror("history open");
+}
+
+// Maps the history file and appends its entries to history without copying them.
+// Only the record headers are read here, the text is paged in when something looks at it.
+// Damaged bytes, from a crash mid-write or something else writing to the file, are skipped and repaired
+void history_load(s_vector* history)
+{
+    char* path = history_file_path();
+    if (!path) { return; }
+
+    history_fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (history_fd == -1)
+    {
+        fprintf(stderr, "%s: ", path);
+        perror("open");
+        free(path);
+        return;
+    }
+
+    // Open for the shell's whole life, so out of reach of a command's >&3
+    history_fd = redirect_hide_fd(history_fd);
+
+    struct stat s;
+    if (fstat(history_fd, &s) == -1)
+    {
+        perror("fstat");
+        exit(EXIT_FAILURE);
+    }
+
+    if (s.st_size == 0)
+    {
+        if (write(history_fd, HISTORY_MAGIC, HISTORY_MAGIC_SIZE) != HISTORY_MAGIC_SIZE)
+            perror("history write");
+
+        free(path);
+        return;
+    }
+
+    history_map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, history_fd, 0);
+    if (history_map == MAP_FAILED)
+    {
+        perror("mmap");
+        history_map = NULL;
+        free(path);
+        return;
+    }
+    history_map_size = s.st_size;
+
+    if (history_map_size < HISTORY_MAGIC_SIZE || memcmp(history_map, HISTORY_MAGIC, HISTORY_MAGIC_SIZE))
+    {
+        fprintf(stderr, "%s: not a rash history file, history won't be saved\n", path);
+        munmap(history_map, history_map_size);
+        history_map = NULL;
+        history_map_size = 0;
+        close(history_fd);
+        history_fd = -1;
+        free(path);
+        return;
+    }
+
+    madvise(history_map, history_map_size, MADV_SEQUENTIAL);
+
+    size_t offset = HISTORY_MAGIC_SIZE;
+    size_t intact_end = offset;
+    size_t damaged = 0;
+    history_record record;
+    while (next_intact_record(history_map, history_map_size, &offset, &record, &damaged))
+    {
+        if (record.length)
+            add_string(history, (char*)record.text, false);
+        intact_end = offset;
+    }
+
+    // Searches jump around from here on
+    madvise(history_map, history_map_size, MADV_RANDOM);
+
+    if (damaged)
+        repair(path, intact_end, damaged);
+
+    free(path);
+}
+
+// FNV-1a
+static size_t hash_string(const char* s)
+{
+    size_t h = 14695981039346656037ULL;
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Returns the slot holding the entry equal to line, or the empty slot where it should be inserted
+static uint32_t* find_line(uint32_t* slots, size_t capacity, const s_vector* history, const char* line)
+{
+    size_t i = hash_string(line) & (capacity - 1);
+
+    while (slots[i] && strcmp(history->data[slots[i] - 1], line))
+    {
+        i = (i + 1) & (capacity - 1);
+    }
+
+    return &slots[i];
+}
+
+static void grow_slots(const s_vector* history)
+{
+    size_t new_capacity = history_slots_capacity ? history_slots_capacity << 1 : min_slots_capacity;
+    uint32_t* new_slots = calloc(new_capacity, sizeof(*new_slots));
+    if (!new_slots)
+    {
+        perror("history calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < history_slots_capacity; i++)
+    {
+        if (history_slots[i])
+            *find_line(new_slots, new_capacity, history, history->data[history_slots[i] - 1]) = history_slots[i];
+    }
+
+    free(history_slots);
+    history_slots = new_slots;
+    history_slots_capacity = new_capacity;
+}
+
+static void grow_meta(size_t size)
+{
+    if (size <= history_meta_capacity) { return; }
+
+    while (history_meta_capacity < size)
+        history_meta_capacity = history_meta_capacity ? history_meta_capacity << 1 : min_slots_capacity;
+
+    uint32_t* uses = realloc(history_uses, sizeof(*history_uses) * history_meta_capacity);
+    int64_t* last_used = realloc(history_last_used, sizeof(*history_last_used) * history_meta_capacity);
+    if (!uses || !last_used)
+    {
+        perror("history realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    history_uses = uses;
+    history_last_used = last_used;
+}
+
+// Records entry i as the newest occurrence of its line, removing an older one if there is one
+static void dedup_entry(s_vector* history, size_t i, int64_t timestamp)
+{
+    if ((history_num_lines + 1) * 2 > history_slots_capacity)
+        grow_slots(history);
+
+    uint32_t* slot = find_line(history_slots, history_slots_capacity, history, history->data[i]);
+    uint32_t uses = 1;
+
+    if (*slot)
+    {
+        size_t previous = *slot - 1;
+        uses = history_uses[previous] + 1;
+
+        if (!history_is_mapped(history->data[previous]))
+            free(history->data[previous]);
+        history->data[previous] = NULL;
+        history_num_removed++;
+    }
+    else
+    {
+        history_num_lines++;
+    }
+
+    *slot = (uint32_t)i + 1;
+    history_uses[i] = uses;
+    history_last_used[i] = timestamp;
+}
+
+// Drops the NULLs left by moved lines once they make up most of the history. Entry indexes change,
+// so the search indexes start over and get rebuilt on their next use
+static void remove_moved(s_vector* history)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < history->size; i++)
+    {
+        if (!history->data[i]) { continue; }
+
+        history->data[kept] = history->data[i];
+        history_uses[kept] = history_uses[i];
+        history_last_used[kept] = history_last_used[i];
+        kept++;
+    }
+    history->size = kept;
+
+    memset(history_slots, 0, sizeof(*history_slots) * history_slots_capacity);
+    for (size_t i = 0; i < history->size; i++)
+        *find_line(history_slots, history_slots_capacity, history, history->data[i]) = (uint32_t)i + 1;
+
+    history_num_deduped = history->size;
+    history_num_removed = 0;
+
+    trigram_index_free(&history_trigrams);
+    fuzzy_index_free(&history_fuzzy);
+}
+
+// Dedups up to max_entries of the entries added without the table, in order, and compacts the history once
+// they're all done if that's due. Returns true if there are more left
+static bool dedup_step(s_vector* history, size_t max_entries)
+{
+    if (history_num_deduped == history->size) { return false; }
+
+    grow_meta(history->size);
+
+    // Sized for the whole history up front, so no step has to rehash what the earlier ones put in
+    while (history->size * 2 > history_slots_capacity)
+        grow_slots(history);
+
+    size_t end = history->size - history_num_deduped > max_entries ? history_num_deduped + max_entries : history->size;
+    for (size_t i = history_num_deduped; i < end; i++)
+    {
+        if (!history->data[i]) { continue; }
+
+        // Entries from the file still have their record header in front of them
+        int64_t timestamp = time(NULL);
+        if (history_is_mapped(history->data[i]))
+            memcpy(&timestamp, history->data[i] - sizeof(timestamp), sizeof(timestamp));
+
+        dedup_entry(history, i, timestamp);
+    }
+    history_num_deduped = end;
+
+    if (end < history->size) { return true; }
+
+    if (history_num_removed > HISTORY_MIN_REMOVED && history_num_removed * 2 > history->size)
+        remove_moved(history);
+
+    return false;
+}
+
+// Brings the dedup table up to date with entries added without it, those loaded from the file and any entered
+// before history_idle got to them. Loading doesn't do this itself since it would have to read every entry.
+// Call before navigating the history, as it may remove entries and shift the rest
+void history_update(s_vector* history)
+{
+    dedup_step(history, SIZE_MAX);
+}
+
+// Adds line to the in memory history and appends it to the history file with a single O_APPEND write,
+// so shells sharing the file never interleave their records
+void history_add(s_vector* history, const char* line)
+{
+    add_string(history, (char*)line, true);
+
+    int64_t timestamp = time(NULL);
+    grow_meta(history->size);
+    history_uses[history->size - 1] = 1;
+    history_last_used[history->size - 1] = timestamp;
+
+    // A line entered before moves to the end rather than being stored twice. Until the table covers
+    // the loaded entries, the new one waits its turn behind them
+    if (history_num_deduped == history->size - 1)
+    {
+        dedup_entry(history, history->size - 1, timestamp);
+        history_num_deduped = history->size;
+
+        if (history_num_removed > HISTORY_MIN_REMOVED && history_num_removed * 2 > history->size)
+            remove_moved(history);
+    }
+
+    // Indexes the new entry if the index has caught up, otherwise takes a step towards it
+    trigram_index_update(&history_trigrams, history, HISTORY_IDLE_STEP);
+
+    if (history_fd == -1) { return; }
+
+    uint32_t length = strlen(line);
+    size_t record_size = HISTORY_HEADER_SIZE + length + 1;
+
+    char small[512];
+    char* record = record_size <= sizeof(small) ? small : malloc(record_size);
+    if (!record)
+    {
+        perror("history malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(record, &length, sizeof(length));
+    memcpy(record + sizeof(length), &timestamp, sizeof(timestamp));
+    memcpy(record + HISTORY_HEADER_SIZE, line, length + 1);
+
+    if (write(history_fd, record, record_size) != (ssize_t)record_size)
+        perror("history write");
+
+    if (record != small)
+        free(record);
+}
+
+// Index of the last entry at or before current_index containing needle, or -1
+ssize_t history_search(s_vector* history, ssize_t current_index, const char* needle)
+{
+    return trigram_index_find(&history_trigrams, history, current_index, needle);
+}
+
+// Does a step of the work the first Enter, Up or search would otherwise wait for: the dedup table first,
+// then the trigram index, then the fuzzy search data. Called while the shell waits for input, until it returns false
+bool history_idle(s_vector* history)
+{
+    return dedup_step(history, HISTORY_IDLE_STEP) || trigram_index_update(&history_trigrams, history, HISTORY_IDLE_STEP) ||
+           fuzzy_index_step(&history_fuzzy, history, HISTORY_IDLE_STEP);
+}
+
+// Best matches for an interactive search, see fuzzy_search
+size_t history_fuzzy_search(s_vector* history, const char* query, fuzzy_result* results, size_t max_results)
+{
+    return fuzzy_search(&history_fuzzy, history, history_uses, query, results, max_results);
+}
+
+bool history_is_mapped(const char* entry)
+{
+    return history_map && entry >= history_map && entry < history_map + history_map_size;
+}
+
+// free_s_vector for the history, which can't free the entries living in the mapped file
+void history_free(s_vector* history)
+{
+    for (size_t i = 0; i < history->size; i++)
+    {
+        if (!history_is_mapped(history->data[i]))
+            free(history->data[i]);
+    }
+    free(history->data);
+
+    history->data = NULL;
+    history->size = history->capacity = 0;
+
+    trigram_index_free(&history_trigrams);
+    fuzzy_index_free(&history_fuzzy);
+
+    free(history_slots);
+    free(history_uses);
+    free(history_last_used);
+    history_slots = NULL;
+    history_uses = NULL;
+    history_last_used = NULL;
+    history_slots_capacity = history_meta_capacity = 0;
+    history_num_lines = history_num_deduped = history_num_removed = 0;
+
+    if (history_map)
+        munmap(history_map, history_map_size);
+    history_map = NULL;
+    history_map_size = 0;
+
+    if (history_fd != -1)
+        close(history_fd);
+    history_fd = -1;
+}
+
+// Rewrites the history file keeping only its newest HISTORY_COMPACT_MAX records and dropping a torn
+// last record. Meant to be run offline ('rash --compact-history'), the new file replaces the old one
+// with a rename, so a shell appending at the same time may lose its last entries
+int history_compact(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        fprintf(stderr, "%s: ", path);
+        perror("open");
+        return EXIT_FAILURE;
+    }
+
+    struct stat s;
+    if (fstat(fd, &s) == -1 || s.st_size < HISTORY_MAGIC_SIZE)
+    {
+        fprintf(stderr, "%s: not a rash history file\n", path);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    char* data = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    if (memcmp(data, HISTORY_MAGIC, HISTORY_MAGIC_SIZE))
+    {
+        fprintf(stderr, "%s: not a rash history file\n", path);
+        munmap(data, s.st_size);
+        return EXIT_FAILURE;
+    }
+
+    // Count first, so only the newest records are written
+    size_t num_records = 0;
+    size_t offset = HISTORY_MAGIC_SIZE;
+    size_t damaged = 0;
+    history_record record;
+    while (next_intact_record(data, s.st_size, &offset, &record, &damaged))
+    {
+        if (record.length) { num_records++; }
+    }
+
+    size_t skip = num_records > HISTORY_COMPACT_MAX ? num_records - HISTORY_COMPACT_MAX : 0;
+
+    size_t kept;
+    bool written = write_records(path, data, s.st_size, skip, &kept);
+    munmap(data, s.st_size);
+
+    if (!written) { return EXIT_FAILURE; }
+
+    if (damaged)
+        printf("%s: dropped %lu damaged bytes\n", path, damaged);
+    printf("%s: kept %lu of %lu entries\n", path, kept, num_records);
+
+    return EXIT_SUCCESS;
+}
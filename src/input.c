@@ -0,0 +1,388 @@
+#include "../include/input.h"
+
+// Everything read from the terminal and not decoded yet is buffer[start, size)
+static char* buffer = NULL;
+static size_t start = 0;
+static size_t size = 0;
+static size_t capacity = 0;
+
+// No more input came to complete the escape sequence at the front, so it's taken as it is
+static bool escape_timed_out = false;
+
+// Text of the bracketed paste being read, or the last one once it's done
+static char* paste = NULL;
+static size_t paste_size = 0;
+static size_t paste_capacity = 0;
+static bool in_paste = false;
+
+static const char paste_end[] = "\033[201~";
+
+bool is_alpha_numeric_symbolic(char c)
+{
+    return (c >= 32 && c <= 126);
+}
+
+static void reserve(char** data, size_t* data_capacity, size_t needed)
+{
+    if (needed <= *data_capacity) { return; }
+
+    size_t new_capacity = *data_capacity ? *data_capacity : 256;
+    while (new_capacity < needed) { new_capacity <<= 1; }
+
+    char* temp = realloc(*data, new_capacity);
+    if (!temp)
+    {
+        perror("input realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    *data = temp;
+    *data_capacity = new_capacity;
+}
+
+// Reads whatever the terminal has right now without blocking
+static void drain()
+{
+    while (true)
+    {
+        if (start)
+        {
+            memmove(buffer, buffer + start, size - start);
+            size -= start;
+            start = 0;
+        }
+
+        reserve(&buffer, &capacity, size + 4096);
+
+        ssize_t n = read(STDIN_FILENO, buffer + size, capacity - size);
+        if (n == -1)
+        {
+            if (errno == EINTR) { continue; }
+
+            perror("Read error");
+            exit(EXIT_FAILURE);
+        }
+        // The terminal is gone
+        if (n == 0) { exit(EXIT_SUCCESS); }
+
+        size += n;
+        escape_timed_out = false;
+
+        struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+        if (poll(&pfd, 1, 0) <= 0) { return; }
+    }
+}
+
+// Waits for input with wait_mask as the signal mask and reads all of it, so every key typed or pasted
+// since the last call gets decoded in one batch. When only part of an escape sequence is in, waits a moment
+// for the rest instead. Until then idle is called a step at a time between polls that don't wait, for as
+// long as it returns true, so a key waits for one step at most. Returns false if a signal came first, or
+// wake_fd became readable while no input did
+bool input_fill(const sigset_t* wait_mask, int wake_fd, bool (*idle)())
+{
+    // Keys typed while waiting for a cursor position report come first
+    char pending[64];
+    size_t n;
+    bool added = false;
+    while ((n = take_pending_input(pending, sizeof(pending))))
+    {
+        reserve(&buffer, &capacity, size + n);
+        memcpy(buffer + size, pending, n);
+        size += n;
+        added = true;
+    }
+    if (added)
+    {
+        escape_timed_out = false;
+        return true;
+    }
+
+    bool escape_wait = start < size && !in_paste;
+    bool idle_left = idle != NULL;
+    struct timespec timeout = { 0, INPUT_ESCAPE_TIMEOUT_MS * 1000000L };
+    struct timespec no_wait = { 0, 0 };
+
+    struct pollfd pfds[2] =
+    {
+        { .fd = STDIN_FILENO, .events = POLLIN },
+        { .fd = wake_fd, .events = POLLIN },
+    };
+
+    int ready;
+    while (true)
+    {
+        ready = ppoll(pfds, wake_fd == -1 ? 1 : 2, escape_wait ? &timeout : (idle_left ? &no_wait : NULL), wait_mask);
+        if (ready == -1)
+        {
+            if (errno == EINTR) { return false; }
+
+            perror("ppoll");
+            exit(EXIT_FAILURE);
+        }
+
+        if (ready || escape_wait) { break; }
+
+        idle_left = idle();
+    }
+
+    if (ready == 0)
+    {
+        escape_timed_out = true;
+        return true;
+    }
+
+    if (!(pfds[0].revents & (POLLIN | POLLHUP | POLLERR))) { return false; }
+
+    drain();
+    return true;
+}
+
+// Length of the CSI sequence at s (\e[ params final), 0 if it isn't complete
+static size_t csi_length(const char* s, size_t n)
+{
+    for (size_t i = 2; i < n; i++)
+    {
+        if (s[i] >= 0x40 && s[i] <= 0x7e) { return i + 1; }
+        if (s[i] < 0x20 || s[i] > 0x3f) { return i; }
+    }
+
+    return 0;
+}
+
+static KEY csi_key(const char* s, size_t n)
+{
+    static const struct { const char* sequence; KEY key; } keys[] =
+    {
+        { "\033[A", KEY_UP },
+        { "\033[B", KEY_DOWN },
+        { "\033[C", KEY_RIGHT },
+        { "\033[D", KEY_LEFT },
+        { "\033[1;5A", KEY_C_UP },
+        { "\033[1;5B", KEY_C_DOWN },
+        { "\033[1;5C", KEY_C_RIGHT },
+        { "\033[1;5D", KEY_C_LEFT },
+        { "\033[3~", KEY_DELETE },
+    };
+
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    {
+        if (strlen(keys[i].sequence) == n && !memcmp(keys[i].sequence, s, n))
+            return keys[i].key;
+    }
+
+    return KEY_UNASSIGNED;
+}
+
+static KEY control_key(char c)
+{
+    switch (c)
+    {
+        case '\000': return KEY_C_AT;
+        case '\001': return KEY_C_A;
+        case '\002': return KEY_C_B;
+        case '\003': return KEY_C_C;
+        case '\004': return KEY_C_D;
+        case '\005': return KEY_C_E;
+        case '\006': return KEY_C_F;
+        case '\007': return KEY_C_G;
+        case '\010': return KEY_BACKSPACE; // C-H
+        case '\177': return KEY_BACKSPACE;
+        case '\011': return KEY_C_I;
+        case '\012': return KEY_ENTER; // C-J
+        case '\013': return KEY_C_K;
+        case '\014': return KEY_C_L;
+        case '\015': return KEY_C_M;
+        case '\016': return KEY_C_N;
+        case '\017': return KEY_C_O;
+        case '\020': return KEY_C_P;
+        case '\021': return KEY_C_Q;
+        case '\022': return KEY_C_R;
+        case '\023': return KEY_C_S;
+        case '\024': return KEY_C_T;
+        case '\025': return KEY_C_U;
+        case '\026': return KEY_C_V;
+        case '\027': return KEY_C_W;
+        case '\030': return KEY_C_X;
+        case '\031': return KEY_C_Y;
+        case '\032': return KEY_C_Z;
+        case '\034': return KEY_C_BACKSLASH;
+        case '\035': return KEY_C_RBRACKET;
+        case '\036': return KEY_C_CARET;
+        case '\037': return KEY_C_UNDERSCORE;
+        default: return KEY_UNASSIGNED;
+    }
+}
+
+// The line only holds printable characters, so tabs in a paste become spaces and other control characters
+// are dropped. Its lines are joined with "; " to still run as separate commands, unless one ends in an
+// operator like | or && that carries on to the next, or in a backslash continuation
+static void clean_paste()
+{
+    while (paste_size && (paste[paste_size - 1] == '\n' || paste[paste_size - 1] == '\r')) { paste_size--; }
+
+    // Each line break takes two characters at most
+    size_t text_capacity = paste_size * 2 + 1;
+    char* text = malloc(text_capacity);
+    if (!text)
+    {
+        perror("input malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < paste_size; i++)
+    {
+        char c = paste[i];
+        if (c == '\r' && i + 1 < paste_size && paste[i + 1] == '\n') { continue; }
+
+        if (c == '\n' || c == '\r')
+        {
+            while (kept && text[kept - 1] == ' ') { kept--; }
+            if (!kept) { continue; }
+
+            if (text[kept - 1] == '\\')
+                text[kept - 1] = ' ';
+            else if (strchr("|&;", text[kept - 1]))
+                text[kept++] = ' ';
+            else
+            {
+                text[kept++] = ';';
+                text[kept++] = ' ';
+            }
+        }
+        else if (c == '\t')
+            text[kept++] = ' ';
+        else if (is_alpha_numeric_symbolic(c))
+            text[kept++] = c;
+    }
+
+    free(paste);
+    paste = text;
+    paste_size = kept;
+    paste_capacity = text_capacity;
+}
+
+// Moves the paste text read so far out of the buffer, returning true once the paste is complete
+static bool read_paste()
+{
+    const char* available = buffer + start;
+    size_t n = size - start;
+
+    const char* end = memmem(available, n, paste_end, sizeof(paste_end) - 1);
+
+    // The end marker could be split across reads, so its possible start stays in the buffer
+    size_t taken = end ? (size_t)(end - available) : (n >= sizeof(paste_end) - 1 ? n - (sizeof(paste_end) - 2) : 0);
+
+    reserve(&paste, &paste_capacity, paste_size + taken);
+    memcpy(paste + paste_size, available, taken);
+    paste_size += taken;
+    start += taken;
+
+    if (!end) { return false; }
+
+    start += sizeof(paste_end) - 1;
+    in_paste = false;
+    clean_paste();
+
+    return true;
+}
+
+// Decodes the next key in the buffer. c is set to the character for KEY_ALPHA_NUM_SYMBOL.
+// Returns false when what's left is incomplete or there's nothing left
+bool input_next(KEY* key, char* c)
+{
+    while (true)
+    {
+        if (in_paste)
+        {
+            if (!read_paste()) { return false; }
+
+            *key = KEY_PASTE;
+            *c = '\0';
+            return true;
+        }
+
+        if (start == size) { return false; }
+
+        const char* s = buffer + start;
+        size_t n = size - start;
+        *c = s[0];
+
+        if (s[0] != '\033')
+        {
+            start++;
+            *key = is_alpha_numeric_symbolic(s[0]) ? KEY_ALPHA_NUM_SYMBOL : control_key(s[0]);
+            return true;
+        }
+
+        if (n == 1 || (s[1] == 'O' && n == 2))
+        {
+            if (!escape_timed_out) { return false; }
+
+            // Nothing followed, so it was the Escape key itself
+            start++;
+            *key = KEY_ESCAPE;
+            return true;
+        }
+
+        if (s[1] == '[')
+        {
+            size_t length = csi_length(s, n);
+            if (!length)
+            {
+                if (!escape_timed_out) { return false; }
+                length = n;
+            }
+            start += length;
+
+            if (length == 6 && !memcmp(s, "\033[200~", 6))
+            {
+                in_paste = true;
+                paste_size = 0;
+                continue;
+            }
+
+            *key = csi_key(s, length);
+            return true;
+        }
+
+        if (s[1] == 'O')
+        {
+            // Arrow keys in application cursor mode
+            char sequence[3] = { '\033', '[', s[2] };
+            start += 3;
+            *key = csi_key(sequence, 3);
+            return true;
+        }
+
+        if (s[1] == '\033')
+        {
+            start++;
+            *key = KEY_ESCAPE;
+            return true;
+        }
+
+        // Alt with a key, not bound to anything
+        start += 2;
+        *key = KEY_UNASSIGNED;
+        return true;
+    }
+}
+
+// Text of the last bracketed paste, valid until the next call to input_next
+const char* input_paste(size_t* paste_length)
+{
+    *paste_length = paste_size;
+    return paste;
+}
+
+void input_free()
+{
+    free(buffer);
+    free(paste);
+
+    buffer = NULL;
+    paste = NULL;
+    start = size = capacity = 0;
+    paste_size = paste_capacity = 0;
+}
@@ -0,0 +1,393 @@
+#include "../include/job.h"
+
+job_table jobs = {NULL, 0, 0};
+pid_t shell_pgid = 0;
+bool job_control = false;
+
+// Process group of the foreground job, -1 if there is none
+pid_t active_child = -1;
+
+volatile sig_atomic_t child_status_changed = 0;
+
+// What the stages of the last foreground job that finished used, summed up
+struct rusage last_job_usage = {0};
+
+static void sigchld_handler(int signum)
+{
+    (void)signum;
+    child_status_changed = 1;
+}
+
+// SIGCHLD only marks that something changed, reaping happens later from the main loop.
+// It stays blocked except while the editor waits for input, so no other system call gets interrupted.
+// Job control is only enabled when the shell is interactive and owns the terminal
+void init_job_control(bool interactive)
+{
+    struct sigaction sa = {0};
+    sa.sa_handler = sigchld_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    shell_pgid = getpgrp();
+    job_control = interactive && isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == shell_pgid;
+
+    // The shell hands the terminal to each foreground job and takes it back afterwards
+    if (job_control)
+    {
+        signal(SIGTTOU, SIG_IGN);
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+    }
+}
+
+job* job_add(pid_t pgid, const pid_t* pids, size_t num_procs, char* text)
+{
+    if (jobs.size == jobs.capacity)
+    {
+        jobs.capacity = (jobs.capacity == 0) ? 1 : jobs.capacity << 1;
+        job** temp = realloc(jobs.data, sizeof(*jobs.data) * jobs.capacity);
+        if (!temp)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        jobs.data = temp;
+    }
+
+    job* j = calloc(1, sizeof(*j));
+    if (j)
+        j->procs = calloc(num_procs, sizeof(*j->procs));
+    if (!j || !j->procs)
+    {
+        perror("job calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < num_procs; i++)
+        j->procs[i].pid = pids[i];
+
+    j->id = jobs.size ? jobs.data[jobs.size - 1]->id + 1 : 1;
+    j->pgid = pgid;
+    j->num_procs = num_procs;
+    j->state = JOB_RUNNING;
+    j->text = text;
+    j->notified = true;
+
+    jobs.data[jobs.size++] = j;
+    return j;
+}
+
+void job_remove(job* j)
+{
+    for (size_t i = 0; i < jobs.size; i++)
+    {
+        if (jobs.data[i] == j)
+        {
+            memmove(jobs.data + i, jobs.data + i + 1, (jobs.size - i - 1) * sizeof(*jobs.data));
+            jobs.size--;
+            break;
+        }
+    }
+
+    free(j->procs);
+    free(j->text);
+    free(j);
+}
+
+// Finds a job from a '%n' or 'n' job spec. A NULL spec means the most recent job
+job* job_find(const char* spec)
+{
+    if (!jobs.size) { return NULL; }
+    if (!spec) { return jobs.data[jobs.size - 1]; }
+
+    if (*spec == '%') { spec++; }
+
+    char* end = NULL;
+    long id = strtol(spec, &end, 10);
+    if (end == spec || *end) { return NULL; }
+
+    for (size_t i = 0; i < jobs.size; i++)
+    {
+        if (jobs.data[i]->id == id)
+            return jobs.data[i];
+    }
+
+    return NULL;
+}
+
+static void update_job_state(job* j)
+{
+    bool all_completed = true;
+    bool any_running = false;
+
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        if (!j->procs[i].completed)
+        {
+            all_completed = false;
+            if (!j->procs[i].stopped)
+                any_running = true;
+        }
+    }
+
+    job_state state = all_completed ? JOB_DONE : (any_running ? JOB_RUNNING : JOB_STOPPED);
+    if (state != j->state)
+    {
+        j->state = state;
+        j->notified = false;
+    }
+}
+
+// Records a status reported by wait4, with the resources the process used if it's done.
+// Returns false if pid doesn't belong to any job
+bool update_process(pid_t pid, int status, const struct rusage* usage)
+{
+    for (size_t i = 0; i < jobs.size; i++)
+    {
+        job* j = jobs.data[i];
+
+        for (size_t k = 0; k < j->num_procs; k++)
+        {
+            process* p = &j->procs[k];
+            if (p->pid != pid) { continue; }
+
+            if (WIFSTOPPED(status))
+            {
+                p->stopped = true;
+            }
+            else if (WIFCONTINUED(status))
+            {
+                p->stopped = false;
+            }
+            else
+            {
+                p->completed = true;
+                p->status = status;
+                p->usage = *usage;
+            }
+
+            update_job_state(j);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Collects every pending child status change without blocking.
+// Returns true if a job changed state and the user hasn't been told yet
+bool job_reap()
+{
+    child_status_changed = 0;
+
+    int status = 0;
+    struct rusage usage;
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0)
+    {
+        update_process(pid, status, &usage);
+    }
+
+    for (size_t i = 0; i < jobs.size; i++)
+    {
+        if (!jobs.data[i]->notified)
+            return true;
+    }
+
+    return false;
+}
+
+// Blocks until every stage of j has exited or the job is stopped
+void job_wait(job* j)
+{
+    while (j->state == JOB_RUNNING)
+    {
+        int status = 0;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, WUNTRACED, &usage);
+        if (pid == -1)
+        {
+            if (errno == EINTR) { continue; }
+
+            // Nothing left to wait for
+            for (size_t i = 0; i < j->num_procs; i++)
+                j->procs[i].completed = true;
+            update_job_state(j);
+            break;
+        }
+
+        update_process(pid, status, &usage);
+    }
+}
+
+static void add_time(struct timeval* total, const struct timeval* t)
+{
+    total->tv_sec += t->tv_sec;
+    total->tv_usec += t->tv_usec;
+    if (total->tv_usec >= 1000000)
+    {
+        total->tv_sec++;
+        total->tv_usec -= 1000000;
+    }
+}
+
+// Sums up what the finished stages of j used. maxrss is the largest of theirs, since they ran side by side
+void job_usage(const job* j, struct rusage* usage)
+{
+    memset(usage, 0, sizeof(*usage));
+
+    for (size_t i = 0; i < j->num_procs; i++)
+    {
+        const struct rusage* u = &j->procs[i].usage;
+
+        add_time(&usage->ru_utime, &u->ru_utime);
+        add_time(&usage->ru_stime, &u->ru_stime);
+        if (u->ru_maxrss > usage->ru_maxrss) { usage->ru_maxrss = u->ru_maxrss; }
+        usage->ru_majflt += u->ru_majflt;
+        usage->ru_minflt += u->ru_minflt;
+        usage->ru_nvcsw += u->ru_nvcsw;
+        usage->ru_nivcsw += u->ru_nivcsw;
+    }
+}
+
+// Exit status of the job's last stage, following the shell convention of 128 + signal for killed jobs
+int job_exit_status(const job* j)
+{
+    int status = j->procs[j->num_procs - 1].status;
+
+    if (WIFEXITED(status)) { return WEXITSTATUS(status); }
+    if (WIFSIGNALED(status)) { return 128 + WTERMSIG(status); }
+    return 0;
+}
+
+// Gives j the terminal, optionally continuing it, and waits for it to finish or stop.
+// Finished jobs are removed from the table. Returns the job's exit status
+int job_foreground(job* j, bool cont)
+{
+    if (job_control)
+    {
+        tcsetpgrp(STDIN_FILENO, j->pgid);
+        active_child = j->pgid;
+    }
+
+    if (cont)
+    {
+        for (size_t i = 0; i < j->num_procs; i++)
+            j->procs[i].stopped = false;
+        j->state = JOB_RUNNING;
+
+        if (kill(-j->pgid, SIGCONT) == -1)
+            perror("kill");
+    }
+
+    job_wait(j);
+
+    // The job could have left the cursor anywhere
+    cursor_column_known = false;
+
+    if (job_control)
+    {
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+        active_child = -1;
+    }
+
+    if (j->state == JOB_STOPPED)
+    {
+        printf("\n");
+        print_job(j);
+        j->notified = true;
+        return 128 + SIGTSTP;
+    }
+
+    int status = job_exit_status(j);
+    int stage_status = j->procs[j->num_procs - 1].status;
+
+    // Like other shells, stay quiet about the signals users send on purpose
+    if (WIFSIGNALED(stage_status) && WTERMSIG(stage_status) == SIGINT)
+        printf("\n");
+    else if (WIFSIGNALED(stage_status) && WTERMSIG(stage_status) != SIGPIPE)
+        printf("%s\n", strsignal(WTERMSIG(stage_status)));
+
+    job_usage(j, &last_job_usage);
+    job_remove(j);
+    return status;
+}
+
+// Continues a stopped job without giving it the terminal
+void job_background(job* j)
+{
+    for (size_t i = 0; i < j->num_procs; i++)
+        j->procs[i].stopped = false;
+    j->state = JOB_RUNNING;
+    j->notified = true;
+
+    if (kill(-j->pgid, SIGCONT) == -1)
+        perror("kill");
+}
+
+void print_job(const job* j)
+{
+    const char* state = "Running";
+    char buffer[32];
+
+    if (j->state == JOB_STOPPED)
+    {
+        state = "Stopped";
+    }
+    else if (j->state == JOB_DONE)
+    {
+        int status = j->procs[j->num_procs - 1].status;
+
+        if (WIFSIGNALED(status))
+        {
+            state = strsignal(WTERMSIG(status));
+        }
+        else if (WEXITSTATUS(status))
+        {
+            snprintf(buffer, sizeof(buffer), "Exit %d", WEXITSTATUS(status));
+            state = buffer;
+        }
+        else
+        {
+            state = "Done";
+        }
+    }
+
+    bool current = jobs.size && jobs.data[jobs.size - 1] == j;
+    printf("[%d]%c  %-24s%s\n", j->id, current ? '+' : ' ', state, j->text);
+}
+
+// Tells the user about background jobs that stopped or finished, and forgets the finished ones.
+// Without job control (scripts), they are forgotten silently
+void job_notify()
+{
+    for (size_t i = 0; i < jobs.size; i++)
+    {
+        job* j = jobs.data[i];
+        if (j->notified) { continue; }
+
+        if (job_control)
+            print_job(j);
+        j->notified = true;
+
+        if (j->state == JOB_DONE)
+        {
+            job_remove(j);
+            i--;
+        }
+    }
+}
+
+void free_jobs()
+{
+    while (jobs.size)
+        job_remove(jobs.data[jobs.size - 1]);
+
+    free(jobs.data);
+}
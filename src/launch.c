@@ -0,0 +1,273 @@
+#include "../include/launch.h"
+#include "../include/redirect.h"
+
+#ifdef RASH_LAUNCH_FORK
+#include <sys/wait.h>
+#else
+#include <spawn.h>
+#endif
+
+extern char** environ;
+
+// Signals the shell catches or ignores that children should start with the default disposition of
+static const int default_signals[] = { SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU };
+
+// The next free action, or NULL when they're all taken. Then the spec is marked so launch fails,
+// rather than starting the child without one of its redirections
+static launch_action* next_action(launch_spec* spec)
+{
+    if (spec->num_actions == LAUNCH_MAX_ACTIONS)
+    {
+        spec->overflowed = true;
+        return NULL;
+    }
+
+    launch_action* action = &spec->actions[spec->num_actions++];
+    memset(action, 0, sizeof(*action));
+    return action;
+}
+
+bool launch_add_open(launch_spec* spec, int fd, const char* path, int flags, mode_t mode)
+{
+    launch_action* action = next_action(spec);
+    if (!action) { return false; }
+
+    action->type = LAUNCH_OPEN;
+    action->fd = fd;
+    action->path = path;
+    action->flags = flags;
+    action->mode = mode;
+    return true;
+}
+
+bool launch_add_dup2(launch_spec* spec, int src_fd, int fd)
+{
+    launch_action* action = next_action(spec);
+    if (!action) { return false; }
+
+    action->type = LAUNCH_DUP2;
+    action->src_fd = src_fd;
+    action->fd = fd;
+    return true;
+}
+
+bool launch_add_close(launch_spec* spec, int fd)
+{
+    launch_action* action = next_action(spec);
+    if (!action) { return false; }
+
+    action->type = LAUNCH_CLOSE;
+    action->fd = fd;
+    return true;
+}
+
+// Whether every action the child needs fit in spec, printing why not otherwise
+static bool actions_fit(const launch_spec* spec)
+{
+    if (spec->overflowed)
+        fprintf(stderr, "rash: %s: more than %d file actions\n", spec->argv[0], LAUNCH_MAX_ACTIONS);
+
+    return !spec->overflowed;
+}
+
+#ifdef RASH_LAUNCH_FORK
+
+// Runs in the forked child before exec. Returns 0, or the errno of the action that failed
+static int apply_actions(const launch_spec* spec)
+{
+    for (size_t i = 0; i < spec->num_actions; i++)
+    {
+        const launch_action* action = &spec->actions[i];
+
+        switch (action->type)
+        {
+            case LAUNCH_OPEN:
+            {
+                int fd = open(action->path, action->flags, action->mode);
+                if (fd == -1) { return errno; }
+
+                if (fd != action->fd)
+                {
+                    if (dup2(fd, action->fd) == -1) { return errno; }
+                    close(fd);
+                }
+                break;
+            }
+            case LAUNCH_DUP2:
+                if (dup2(action->src_fd, action->fd) == -1) { return errno; }
+                break;
+            case LAUNCH_CLOSE:
+                close(action->fd);
+                break;
+        }
+    }
+
+    return 0;
+}
+
+// Starts spec->path with fork+execv and returns once the child ran it, like posix_spawn does. The child
+// reports a failed action or exec through a pipe, so like posix_spawn this returns -1 then, with the child
+// reaped. Returns the child's pid, or -1 if it couldn't be started
+pid_t launch(const launch_spec* spec)
+{
+    if (!actions_fit(spec)) { return -1; }
+
+    // The child's end closes with the exec, or carries its errno. Kept out of reach of the child's redirections
+    int exec_pipe[2];
+    if (pipe2(exec_pipe, O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        return -1;
+    }
+    exec_pipe[0] = redirect_hide_fd(exec_pipe[0]);
+    exec_pipe[1] = redirect_hide_fd(exec_pipe[1]);
+
+    pid_t pid = fork();
+
+    switch (pid)
+    {
+        case -1:
+            perror("fork");
+            close(exec_pipe[0]);
+            close(exec_pipe[1]);
+            return -1;
+        case 0:
+        {
+            if (spec->set_pgid)
+                setpgid(0, spec->pgid);
+
+            // Still ignoring SIGTTOU here, like the shell
+            if (spec->foreground)
+                tcsetpgrp(STDIN_FILENO, getpgrp());
+
+            for (size_t i = 0; i < sizeof(default_signals) / sizeof(*default_signals); i++)
+                signal(default_signals[i], SIG_DFL);
+
+            sigset_t empty;
+            sigemptyset(&empty);
+            sigprocmask(SIG_SETMASK, &empty, NULL);
+
+            int err = apply_actions(spec);
+            if (!err)
+            {
+                execv(spec->path, spec->argv);
+                err = errno;
+            }
+
+            if (write(exec_pipe[1], &err, sizeof(err)) == -1) { /* The parent sees the pipe close either way */ }
+            _exit(127);
+        }
+        default:
+        {
+            // Set the group from both sides so neither the parent nor the child can race ahead of it
+            if (spec->set_pgid)
+                setpgid(pid, spec->pgid ? spec->pgid : pid);
+
+            close(exec_pipe[1]);
+            int err = 0;
+            ssize_t n;
+            while ((n = read(exec_pipe[0], &err, sizeof(err))) == -1 && errno == EINTR) { }
+            close(exec_pipe[0]);
+
+            if (n == sizeof(err))
+            {
+                waitpid(pid, NULL, 0);
+                fprintf(stderr, "%s: %s\n", spec->argv[0], strerror(err));
+                return -1;
+            }
+
+            return pid;
+        }
+    }
+}
+
+#else
+
+// Starts spec->path with posix_spawn, which glibc implements with clone(CLONE_VM|CLONE_VFORK),
+// so the cost doesn't grow with the size of the shell's heap.
+// Returns the child's pid, or -1 if it couldn't be started
+pid_t launch(const launch_spec* spec)
+{
+    posix_spawn_file_actions_t file_actions;
+    posix_spawnattr_t attr;
+    int err = 0;
+
+    if (!actions_fit(spec)) { return -1; }
+
+    if ((err = posix_spawn_file_actions_init(&file_actions)))
+    {
+        fprintf(stderr, "posix_spawn_file_actions_init: %s\n", strerror(err));
+        exit(EXIT_FAILURE);
+    }
+
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 35)
+    // Runs after the child joined its process group, and first, while stdin is still the terminal
+    if (spec->foreground)
+        err = posix_spawn_file_actions_addtcsetpgrp_np(&file_actions, STDIN_FILENO);
+#endif
+#endif
+
+    for (size_t i = 0; i < spec->num_actions && !err; i++)
+    {
+        const launch_action* action = &spec->actions[i];
+
+        switch (action->type)
+        {
+            case LAUNCH_OPEN:
+                err = posix_spawn_file_actions_addopen(&file_actions, action->fd, action->path, action->flags, action->mode);
+                break;
+            case LAUNCH_DUP2:
+                err = posix_spawn_file_actions_adddup2(&file_actions, action->src_fd, action->fd);
+                break;
+            case LAUNCH_CLOSE:
+                err = posix_spawn_file_actions_addclose(&file_actions, action->fd);
+                break;
+        }
+    }
+
+    if (err)
+    {
+        fprintf(stderr, "posix_spawn_file_actions: %s\n", strerror(err));
+        exit(EXIT_FAILURE);
+    }
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    for (size_t i = 0; i < sizeof(default_signals) / sizeof(*default_signals); i++)
+        sigaddset(&signals, default_signals[i]);
+
+    // The shell keeps SIGCHLD blocked outside of its input loop
+    sigset_t empty;
+    sigemptyset(&empty);
+
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigdefault(&attr, &signals);
+    posix_spawnattr_setsigmask(&attr, &empty);
+
+    if (spec->set_pgid)
+    {
+        posix_spawnattr_setpgroup(&attr, spec->pgid);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+
+    posix_spawnattr_setflags(&attr, flags);
+
+    pid_t pid = -1;
+    err = posix_spawn(&pid, spec->path, &file_actions, &attr, spec->argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&file_actions);
+
+    if (err)
+    {
+        fprintf(stderr, "%s: %s\n", spec->argv[0], strerror(err));
+        return -1;
+    }
+
+    return pid;
+}
+
+#endif
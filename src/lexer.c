@@ -0,0 +1,368 @@
+#include "../include/lexer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEXER_X86 1
+#endif
+
+const char* const delim_strings[] =
+{
+    "ALPHANUMERIC",
+    "WHITESPACE",
+    "PIPE",
+    "OUT_REDIR",
+    "IN_REDIR",
+    "SEMI_COLON",
+    "AMPERSAND",
+    "QUOTE",
+    "DOUBLE_QUOTE",
+};
+
+// Text handed out for operator tokens, the buffer itself may be overwritten while the line runs
+static const char* const operator_strings[] =
+{
+    [PIPE] = "|",
+    [OUT_REDIR] = ">",
+    [IN_REDIR] = "<",
+    [SEMI_COLON] = ";",
+    [AMPERSAND] = "&",
+};
+
+// Class of every byte. Anything not listed is part of a word (ALPHANUMERIC is 0)
+static const unsigned char char_class[256] =
+{
+    [' ']  = WHITESPACE,
+    ['\t'] = WHITESPACE,
+    ['\n'] = WHITESPACE,
+    ['\0'] = WHITESPACE,
+    ['|']  = PIPE,
+    ['>']  = OUT_REDIR,
+    ['<']  = IN_REDIR,
+    [';']  = SEMI_COLON,
+    ['&']  = AMPERSAND,
+    ['\''] = QUOTE,
+    ['"']  = DOUBLE_QUOTE,
+};
+
+// The same bytes, for the vectorized scans. Must list every byte char_class doesn't map to ALPHANUMERIC
+static const char special_chars[] = { ' ', '\t', '\n', '\0', '|', '>', '<', ';', '&', '\'', '"' };
+#define NUM_SPECIAL_CHARS (sizeof(special_chars) / sizeof(*special_chars))
+
+DELIM delimiter(char c)
+{
+    return (DELIM)char_class[(unsigned char)c];
+}
+
+// Returns the index of the first byte at or after i that isn't part of a word, or size if there is none
+static size_t scan_word_scalar(const char* buffer, size_t i, size_t size)
+{
+    while (i < size && char_class[(unsigned char)buffer[i]] == ALPHANUMERIC) { i++; }
+    return i;
+}
+
+#ifdef LEXER_X86
+
+// 16 bytes per step. SSE2 is part of x86-64, so this is always available there
+static size_t scan_word_sse2(const char* buffer, size_t i, size_t size)
+{
+    __m128i specials[NUM_SPECIAL_CHARS];
+    for (size_t k = 0; k < NUM_SPECIAL_CHARS; k++)
+        specials[k] = _mm_set1_epi8(special_chars[k]);
+
+    while (i + 16 <= size)
+    {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(buffer + i));
+        __m128i found = _mm_setzero_si128();
+
+        for (size_t k = 0; k < NUM_SPECIAL_CHARS; k++)
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(chunk, specials[k]));
+
+        int mask = _mm_movemask_epi8(found);
+        if (mask) { return i + __builtin_ctz(mask); }
+
+        i += 16;
+    }
+
+    return scan_word_scalar(buffer, i, size);
+}
+
+// 32 bytes per step, picked at runtime on CPUs that have AVX2
+__attribute__((target("avx2")))
+static size_t scan_word_avx2(const char* buffer, size_t i, size_t size)
+{
+    __m256i specials[NUM_SPECIAL_CHARS];
+    for (size_t k = 0; k < NUM_SPECIAL_CHARS; k++)
+        specials[k] = _mm256_set1_epi8(special_chars[k]);
+
+    while (i + 32 <= size)
+    {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(buffer + i));
+        __m256i found = _mm256_setzero_si256();
+
+        for (size_t k = 0; k < NUM_SPECIAL_CHARS; k++)
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(chunk, specials[k]));
+
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(found);
+        if (mask) { return i + __builtin_ctz(mask); }
+
+        i += 32;
+    }
+
+    return scan_word_sse2(buffer, i, size);
+}
+
+#endif
+
+static size_t scan_word_dispatch(const char* buffer, size_t i, size_t size);
+
+static size_t (*scan_word)(const char*, size_t, size_t) = scan_word_dispatch;
+
+// Picks the widest scan the CPU supports on first use
+static size_t scan_word_dispatch(const char* buffer, size_t i, size_t size)
+{
+    lexer_set_simd(true);
+    return scan_word(buffer, i, size);
+}
+
+// Switches between the vectorized and scalar word scans. Returns the name of the scan in use
+const char* lexer_set_simd(bool enable)
+{
+    // A byte missing from special_chars would be skipped over as part of a word
+    for (int c = 0; c < 256; c++)
+        assert(char_class[c] == ALPHANUMERIC || memchr(special_chars, c, NUM_SPECIAL_CHARS));
+
+    scan_word = scan_word_scalar;
+    const char* name = "scalar";
+
+#ifdef LEXER_X86
+    if (enable)
+    {
+        scan_word = scan_word_sse2;
+        name = "sse2";
+
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            scan_word = scan_word_avx2;
+            name = "avx2";
+        }
+    }
+#else
+    (void)enable;
+#endif
+
+    return name;
+}
+
+static void add_token(arena* a, token_vector* tokens, size_t offset, size_t length, DELIM kind, bool needs_copy)
+{
+    if (tokens->size == tokens->capacity)
+    {
+        size_t capacity = (tokens->capacity == 0) ? 16 : tokens->capacity << 1;
+        token* temp = arena_alloc(a, sizeof(*tokens->data) * capacity);
+        if (tokens->size)
+            memcpy(temp, tokens->data, sizeof(*tokens->data) * tokens->size);
+
+        tokens->data = temp;
+        tokens->capacity = capacity;
+    }
+
+    token* t = &tokens->data[tokens->size++];
+    t->offset = offset;
+    t->length = length;
+    t->kind = kind;
+    t->needs_copy = needs_copy;
+    t->saved = '\0';
+}
+
+// Returns the end of the redirection operator starting at i, like >, 2>> or &>. Everything up to the
+// next word is part of it, so a malformed one like >>> reaches the parser whole
+static size_t scan_redirection(const char* buffer, size_t i, size_t size)
+{
+    while (i < size && (buffer[i] == '<' || buffer[i] == '>' || buffer[i] == '&')) { i++; }
+    return i;
+}
+
+static bool all_digits(const char* text, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+    }
+
+    return length != 0;
+}
+
+// Splits input into tokens in one O(n) pass without copying any text. Runs of the same operator
+// character form one token, quoted strings join the word around them. A redirection is one token
+// of kind IN_REDIR or OUT_REDIR, with the descriptor number in front of it if there is one.
+// buffer[nread - 1] must be the line's newline or terminator
+bool tokenize(arena* a, token_vector* tokens, char* buffer, ssize_t nread)
+{
+    if (nread <= 1) { return false; }
+
+    size_t size = (size_t)nread;
+    size_t i = 0;
+
+    while (i < size)
+    {
+        char c = buffer[i];
+        DELIM current_delim = (DELIM)char_class[(unsigned char)c];
+
+        if (current_delim == WHITESPACE)
+        {
+            i++;
+            continue;
+        }
+
+        bool starts_redirection = current_delim == IN_REDIR || current_delim == OUT_REDIR ||
+            (current_delim == AMPERSAND && i + 1 < size && buffer[i + 1] == '>');
+
+        if (starts_redirection)
+        {
+            size_t start = i;
+            i = scan_redirection(buffer, i, size);
+
+            add_token(a, tokens, start, i - start, current_delim == IN_REDIR ? IN_REDIR : OUT_REDIR, false);
+            continue;
+        }
+
+        if (current_delim != ALPHANUMERIC && current_delim != QUOTE && current_delim != DOUBLE_QUOTE)
+        {
+            size_t start = i;
+            while (i < size && buffer[i] == c) { i++; }
+
+            add_token(a, tokens, start, i - start, current_delim, false);
+            continue;
+        }
+
+        // Word, made of plain characters and quoted strings
+        size_t start = i;
+        size_t num_quoted = 0;
+
+        while (i < size)
+        {
+            current_delim = (DELIM)char_class[(unsigned char)buffer[i]];
+
+            if (current_delim == QUOTE || current_delim == DOUBLE_QUOTE)
+            {
+                char* closing = memchr(buffer + i + 1, buffer[i], size - i - 1);
+                if (!closing)
+                {
+                    fprintf(stderr, "missing closing delimiter: %s\n", delim_strings[current_delim]);
+                    return false;
+                }
+
+                num_quoted++;
+                i = (size_t)(closing - buffer) + 1;
+            }
+            else if (current_delim == ALPHANUMERIC)
+            {
+                // Skip the rest of the plain run in one go
+                i = scan_word(buffer, i + 1, size);
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        // Digits right before '<' or '>' name the descriptor being redirected, as in 2>file
+        if (!num_quoted && i < size && (buffer[i] == '<' || buffer[i] == '>') && all_digits(buffer + start, i - start))
+        {
+            DELIM kind = buffer[i] == '<' ? IN_REDIR : OUT_REDIR;
+            i = scan_redirection(buffer, i, size);
+
+            add_token(a, tokens, start, i - start, kind, false);
+            continue;
+        }
+
+        bool only_quoted = num_quoted == 1 && delimiter(buffer[start]) != ALPHANUMERIC && buffer[i - 1] == buffer[start];
+
+        if (only_quoted)
+            add_token(a, tokens, start + 1, i - start - 2, ALPHANUMERIC, false);
+        else
+            add_token(a, tokens, start, i - start, ALPHANUMERIC, num_quoted > 0);
+    }
+
+    return tokens->size != 0;
+}
+
+// Copies a word that mixes quoted and unquoted parts, leaving out the quotes
+static char* copy_without_quotes(arena* a, const char* text, size_t length)
+{
+    char* copy = arena_alloc(a, length + 1);
+    char* end = copy;
+    char quote = '\0';
+
+    for (size_t i = 0; i < length; i++)
+    {
+        DELIM current_delim = delimiter(text[i]);
+
+        if (!quote && (current_delim == QUOTE || current_delim == DOUBLE_QUOTE))
+            quote = text[i];
+        else if (quote && text[i] == quote)
+            quote = '\0';
+        else
+            *end++ = text[i];
+    }
+    *end = '\0';
+
+    return copy;
+}
+
+static bool is_long_redirection(const token* t)
+{
+    return (t->kind == IN_REDIR || t->kind == OUT_REDIR) && t->length > 1;
+}
+
+// Builds the NULL terminated list of token strings used as argv. Words are terminated in place by
+// overwriting the byte after them, which is always a separator that's no longer needed.
+// restore_tokens puts those bytes back once the line is done
+void terminate_tokens(arena* a, token_vector* tokens, char* buffer, s_vector* words)
+{
+    words->data = arena_alloc(a, sizeof(*words->data) * (tokens->size + 1));
+    words->size = tokens->size;
+    words->capacity = tokens->size + 1;
+
+    // Copy mixed words and longer redirections like 2>> before anything in the buffer gets overwritten
+    for (size_t i = 0; i < tokens->size; i++)
+    {
+        token* t = &tokens->data[i];
+        if (t->kind == ALPHANUMERIC && t->needs_copy)
+            words->data[i] = copy_without_quotes(a, buffer + t->offset, t->length);
+        else if (is_long_redirection(t))
+            words->data[i] = arena_strndup(a, buffer + t->offset, t->length);
+    }
+
+    for (size_t i = 0; i < tokens->size; i++)
+    {
+        token* t = &tokens->data[i];
+
+        if (t->kind != ALPHANUMERIC)
+        {
+            if (!is_long_redirection(t))
+                words->data[i] = (char*)operator_strings[t->kind];
+        }
+        else if (!t->needs_copy)
+        {
+            t->saved = buffer[t->offset + t->length];
+            buffer[t->offset + t->length] = '\0';
+            words->data[i] = buffer + t->offset;
+        }
+    }
+
+    words->data[tokens->size] = NULL;
+}
+
+void restore_tokens(const token_vector* tokens, char* buffer)
+{
+    for (size_t i = tokens->size; i > 0; i--)
+    {
+        const token* t = &tokens->data[i - 1];
+
+        if (t->kind == ALPHANUMERIC && !t->needs_copy)
+            buffer[t->offset + t->length] = t->saved;
+    }
+}
@@ -2,6 +2,11 @@
 
 size_t min_size = 8;
 
+static size_t gap_end(const line* l)
+{
+    return l->gap + l->capacity - l->size;
+}
+
 void initialize_line(line* l)
 {
     assert(l != NULL);
@@ -23,30 +28,96 @@ void initialize_line(line* l)
     l->size = 0;
     l->capacity = min_size;
     l->cursor_pos = 0;
+    l->gap = 0;
+    l->borrowed = NULL;
 }
 
 void initialize_line_with_new_data(line* l, char* d)
 {
-    char* copy = strdup(d);
-    if (!copy)
+    size_t line_size = strlen(d);
+    size_t capacity = line_size + 1 > min_size ? line_size + 1 : min_size;
+
+    l->data = malloc(capacity * sizeof(*l->data));
+    if (!l->data)
     {
-        perror("Line history strdup\n");
+        perror("Line malloc\n");
         exit(EXIT_FAILURE);
     }
+    memcpy(l->data, d, line_size + 1);
 
-    l->data = copy;
-
-    int line_size = strlen(l->data);
     l->size = line_size;
     l->cursor_pos = line_size;
-    l->capacity = line_size + 1;
+    l->capacity = capacity;
+    l->gap = line_size;
+    l->borrowed = NULL;
+}
+
+// Shows text without copying it, for stepping through the history. text has to stay valid
+// until the line is edited, cleared, or shows something else. Any buffer the line had is kept for reuse
+void line_show(line* l, const char* text)
+{
+    assert(l != NULL && text != NULL);
+
+    l->borrowed = text;
+    l->size = strlen(text);
+    l->cursor_pos = l->size;
+    l->gap = 0;
+}
+
+// Copies borrowed text into the line's own buffer before it gets edited
+static void own_text(line* l)
+{
+    if (!l->borrowed && l->data) { return; }
+
+    const char* text = l->borrowed;
+    size_t size = l->borrowed ? l->size : 0;
+    size_t cursor_pos = l->cursor_pos;
+
+    if (!l->data || l->capacity <= size)
+    {
+        size_t capacity = l->capacity > min_size ? l->capacity : min_size;
+        while (capacity <= size) { capacity <<= 1; }
+
+        free(l->data);
+        l->data = malloc(capacity * sizeof(*l->data));
+        if (!l->data)
+        {
+            perror("Line malloc\n");
+            exit(EXIT_FAILURE);
+        }
+        l->capacity = capacity;
+    }
+
+    if (size)
+        memcpy(l->data, text, size);
+
+    l->borrowed = NULL;
+    l->size = size;
+    l->gap = size;
+    l->cursor_pos = cursor_pos <= size ? cursor_pos : size;
+}
+
+// Moves the gap so it starts at pos, shifting only the text between the two
+static void move_gap(line* l, size_t pos)
+{
+    size_t end = gap_end(l);
+
+    if (pos < l->gap)
+        memmove(l->data + pos + (end - l->gap), l->data + pos, l->gap - pos);
+    else if (pos > l->gap)
+        memmove(l->data + l->gap, l->data + end, pos - l->gap);
+
+    l->gap = pos;
 }
 
-// Doubles a line's capacity and reallocs the data
+// Doubles a line's capacity and reallocs the data, keeping the text after the gap at the end
 void increase_line_capacity(line * l)
 {
     assert(l != NULL);
 
+    size_t after_gap = l->capacity - gap_end(l);
+    size_t old_capacity = l->capacity;
+
     l->capacity *= 2;
     l->data = realloc(l->data, l->capacity * sizeof(*l->data));
     if (!l->data)
@@ -54,68 +125,68 @@ void increase_line_capacity(line * l)
         perror("Line realloc\n");
         exit(EXIT_FAILURE);
     }
-}
 
+    memmove(l->data + l->capacity - after_gap, l->data + old_capacity - after_gap, after_gap);
+}
 
-void push_back_character(line* l, char c)
+// Inserts length bytes of text at the cursor, in one go however long it is
+void line_insert(line* l, const char* text, size_t length)
 {
     assert(l != NULL);
 
-    if (!l->data) { initialize_line(l); }
+    own_text(l);
 
-    if (l->size + 1 == l->capacity) { increase_line_capacity(l); }
+    while (l->size + length >= l->capacity) { increase_line_capacity(l); }
 
-    *(l->data + l->cursor_pos) = c;
-    *(l->data + l->cursor_pos + 1) = '\0';
+    move_gap(l, l->cursor_pos);
+    memcpy(l->data + l->gap, text, length);
 
-    l->size++;
-    l->cursor_pos++;
+    l->gap += length;
+    l->size += length;
+    l->cursor_pos += length;
 }
 
 // Inserts a character c into line l at wherever the current cursor position is. Resizes if needed
 void insert_character(line* l, char c)
+{
+    line_insert(l, &c, 1);
+}
+
+void push_back_character(line* l, char c)
 {
     assert(l != NULL);
 
-    if (!l->data) { initialize_line(l); }
+    l->cursor_pos = l->size;
+    insert_character(l, c);
+}
 
-    if (l->size + 1 == l->capacity) { increase_line_capacity(l); }
+// Removes the characters in [start, end), moving the cursor along with the text after them
+void line_delete_range(line* l, size_t start, size_t end)
+{
+    assert(l != NULL && start <= end && end <= l->size);
 
-    if (l->size != l->cursor_pos)
-    {
-        memmove(l->data + l->cursor_pos + 1, l->data + l->cursor_pos, l->size - l->cursor_pos);
-        *(l->data + l->cursor_pos) = c;
-    }
-    else
-    {
-        *(l->data + l->cursor_pos) = c;
-        *(l->data + l->cursor_pos + 1) = '\0';
-    }
+    if (start == end) { return; }
+
+    own_text(l);
 
-    l->size++;
-    l->cursor_pos++;
+    move_gap(l, end);
+    l->gap = start;
+    l->size -= end - start;
+
+    if (l->cursor_pos >= end)
+        l->cursor_pos -= end - start;
+    else if (l->cursor_pos > start)
+        l->cursor_pos = start;
 }
 
 bool remove_character(line* l)
 {
     assert(l != NULL);
 
-    if (!l->data) { initialize_line(l); }
-
     if (!l->size) { return false; }
     if (!l->cursor_pos) { return false; }
 
-    if (l->size == l->cursor_pos)
-    {
-        *(l->data + l->size - 1) = '\0';
-    }
-    else
-    {
-        memmove(l->data + l->cursor_pos - 1, l->data + l->cursor_pos, l->size + 1 - l->cursor_pos);
-    }
-
-    l->size--;
-    l->cursor_pos--;
+    line_delete_range(l, l->cursor_pos - 1, l->cursor_pos);
 
     return true;
 }
@@ -126,6 +197,8 @@ void clear_line(line* l)
 
     l->size = 0;
     l->cursor_pos = 0;
+    l->gap = 0;
+    l->borrowed = NULL;
 }
 
 void clear_line_and_free(line* l)
@@ -133,6 +206,7 @@ void clear_line_and_free(line* l)
     clear_line(l);
     free(l->data);
     l->data = NULL;
+    l->capacity = 0;
 }
 
 void move_line_cursor_x(line* l, int x)
@@ -145,3 +219,42 @@ void move_line_cursor_x(line* l, int x)
         l->cursor_pos = (size_t)final_position;
     }
 }
+
+char line_char_at(const line* l, size_t i)
+{
+    assert(i < l->size);
+
+    if (l->borrowed) { return l->borrowed[i]; }
+    return i < l->gap ? l->data[i] : l->data[i + gap_end(l) - l->gap];
+}
+
+// Returns the text as one terminated string in the line's own buffer, which callers may modify
+// as long as they put it back. Closes the gap by moving it to the end
+char* line_c_str(line* l)
+{
+    assert(l != NULL);
+
+    own_text(l);
+    move_gap(l, l->size);
+    l->data[l->size] = '\0';
+
+    return l->data;
+}
+
+// The text in at most two pieces without touching the gap, for drawing it
+void line_segments(const line* l, const char** first, size_t* first_size, const char** second, size_t* second_size)
+{
+    if (l->borrowed)
+    {
+        *first = l->borrowed;
+        *first_size = l->size;
+        *second = NULL;
+        *second_size = 0;
+        return;
+    }
+
+    *first = l->data;
+    *first_size = l->data ? l->gap : 0;
+    *second = l->data ? l->data + gap_end(l) : NULL;
+    *second_size = l->data ? l->size - l->gap : 0;
+}
@@ -0,0 +1,466 @@
+#include "../include/pmap.h"
+#include "../include/shell.h"
+
+// The command template, with PMAP_PLACEHOLDER where each item goes
+static char** template = NULL;
+static int template_size = 0;
+static bool has_placeholder = false;
+
+static pmap_slot* slots = NULL;
+static long num_slots = 0;
+static long num_running = 0;
+static bool group_output = false;
+// Set when stdin is the terminal, not a pipe feeding pmap, and the children can be handed it
+static bool owns_terminal = false;
+
+// Process group of the running children, 0 when none is left and the next child starts a new one
+static pid_t pmap_pgid = 0;
+
+static size_t num_failed = 0;
+// A child was interrupted from the terminal, so no more are started
+static bool interrupted = false;
+
+// Returns the next item, valid until the next call, or NULL when there are none left
+static char* next_item(pmap_items* items)
+{
+    if (!items->from_stdin)
+        return items->next < items->num_args ? items->args[items->next++] : NULL;
+
+    while (true)
+    {
+        char* line = items->buffer + items->start;
+        char* newline = items->start < items->size ? memchr(line, '\n', items->size - items->start) : NULL;
+
+        if (newline || (items->eof && items->start < items->size))
+        {
+            size_t length = newline ? (size_t)(newline - line) : items->size - items->start;
+            items->start += newline ? length + 1 : length;
+
+            if (length && line[length - 1] == '\r') { length--; }
+            line[length] = '\0';
+
+            // Blank lines aren't items
+            if (!length) { continue; }
+            return line;
+        }
+
+        if (items->eof) { return NULL; }
+
+        if (items->start)
+        {
+            memmove(items->buffer, items->buffer + items->start, items->size - items->start);
+            items->size -= items->start;
+            items->start = 0;
+        }
+
+        // One byte more than is read, so the last line can always be terminated
+        if (items->size + PMAP_READ_SIZE + 1 > items->capacity)
+        {
+            size_t capacity = items->capacity ? items->capacity << 1 : PMAP_READ_SIZE * 2;
+            char* temp = realloc(items->buffer, capacity);
+            if (!temp)
+            {
+                perror("pmap realloc");
+                exit(EXIT_FAILURE);
+            }
+
+            items->buffer = temp;
+            items->capacity = capacity;
+        }
+
+        ssize_t n = read(STDIN_FILENO, items->buffer + items->size, PMAP_READ_SIZE);
+        if (n == -1)
+        {
+            if (errno == EINTR) { continue; }
+
+            perror("pmap: read");
+            items->eof = true;
+        }
+        else if (n == 0)
+        {
+            items->eof = true;
+        }
+        else
+        {
+            items->size += n;
+        }
+    }
+}
+
+// Copy of arg with every placeholder replaced by item
+static char* substitute(const char* arg, const char* item)
+{
+    size_t placeholder_length = strlen(PMAP_PLACEHOLDER);
+    size_t item_length = strlen(item);
+
+    size_t count = 0;
+    for (const char* p = arg; (p = strstr(p, PMAP_PLACEHOLDER)); p += placeholder_length) { count++; }
+
+    char* result = malloc(strlen(arg) + count * item_length - count * placeholder_length + 1);
+    if (!result)
+    {
+        perror("pmap malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    char* end = result;
+    for (const char* p = arg; *p; )
+    {
+        const char* next = strstr(p, PMAP_PLACEHOLDER);
+        if (!next)
+        {
+            end = stpcpy(end, p);
+            break;
+        }
+
+        memcpy(end, p, (size_t)(next - p));
+        end = stpcpy(end + (next - p), item);
+        p = next + placeholder_length;
+    }
+    *end = '\0';
+
+    return result;
+}
+
+// The command line for one item. Without a placeholder in the template, the item is the last argument
+static char** build_argv(char* item)
+{
+    char** argv = malloc((template_size + 2) * sizeof(*argv));
+    if (!argv)
+    {
+        perror("pmap malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < template_size; i++)
+        argv[i] = strstr(template[i], PMAP_PLACEHOLDER) ? substitute(template[i], item) : template[i];
+
+    int argc = template_size;
+    if (!has_placeholder)
+        argv[argc++] = item;
+    argv[argc] = NULL;
+
+    return argv;
+}
+
+static void free_argv(char** argv)
+{
+    for (int i = 0; i < template_size; i++)
+    {
+        if (argv[i] != template[i])
+            free(argv[i]);
+    }
+    free(argv);
+}
+
+static int output_buffer(const char* name)
+{
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("memfd_create");
+        exit(EXIT_FAILURE);
+    }
+
+    return redirect_hide_fd(fd);
+}
+
+// Starts the command for item in a free slot. The children share one process group, which gets the terminal
+static void start_item(char* item, bool stdin_is_items)
+{
+    char** argv = build_argv(item);
+
+    uint64_t start = stats_now();
+    const char* path = resolve_executable(argv[0]);
+    stats_record_since(STAT_RESOLVE, start);
+
+    if (!path)
+    {
+        free_argv(argv);
+        num_failed++;
+        return;
+    }
+
+    pmap_slot* slot = &slots[0];
+    while (slot->pid) { slot++; }
+
+    launch_spec spec = {0};
+    spec.path = path;
+    spec.argv = argv;
+    spec.set_pgid = job_control;
+    spec.pgid = pmap_pgid;
+    spec.foreground = owns_terminal && !pmap_pgid;
+
+    // The items are read from stdin, so the commands mustn't read them too
+    if (stdin_is_items)
+        launch_add_open(&spec, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+    if (group_output)
+    {
+        slot->out_fd = output_buffer("pmap stdout");
+        slot->err_fd = output_buffer("pmap stderr");
+        launch_add_dup2(&spec, slot->out_fd, STDOUT_FILENO);
+        launch_add_dup2(&spec, slot->err_fd, STDERR_FILENO);
+    }
+
+    fflush(stdout);
+
+    uint64_t spawn_start = stats_now();
+    pid_t pid = launch(&spec);
+    stats_record_since(STAT_SPAWN, spawn_start);
+
+    free_argv(argv);
+
+    if (pid == -1)
+    {
+        if (group_output)
+        {
+            close(slot->out_fd);
+            close(slot->err_fd);
+        }
+
+        num_failed++;
+        return;
+    }
+
+    if (job_control && !pmap_pgid)
+    {
+        pmap_pgid = pid;
+        if (owns_terminal)
+            tcsetpgrp(STDIN_FILENO, pmap_pgid);
+
+        // Without the terminal, the shell passes on Ctrl-C itself
+        active_child = pmap_pgid;
+    }
+
+    slot->pid = pid;
+    num_running++;
+}
+
+// Writes out everything fd holds. sendfile refuses some targets, files opened for appending among them,
+// and those get a plain copy
+static void flush_output(int fd, int to)
+{
+    off_t size = lseek(fd, 0, SEEK_END);
+    off_t offset = 0;
+
+    while (offset < size)
+    {
+        ssize_t n = sendfile(to, fd, &offset, (size_t)(size - offset));
+        if (n > 0) { continue; }
+        if (n == -1 && errno == EINTR) { continue; }
+        if (n == -1 && (errno == EINVAL || errno == ENOSYS)) { break; }
+
+        close(fd);
+        return;
+    }
+
+    char buffer[PMAP_READ_SIZE];
+    while (offset < size)
+    {
+        ssize_t n = pread(fd, buffer, sizeof(buffer), offset);
+        if (n <= 0) { break; }
+
+        for (ssize_t written = 0; written < n; )
+        {
+            ssize_t w = write(to, buffer + written, (size_t)(n - written));
+            if (w == -1 && errno == EINTR) { continue; }
+            if (w <= 0)
+            {
+                close(fd);
+                return;
+            }
+            written += w;
+        }
+        offset += n;
+    }
+
+    close(fd);
+}
+
+// Waits for one child to finish, passing on the status of any other child to its job
+static void reap_child()
+{
+    int status = 0;
+    struct rusage usage;
+    pid_t pid = wait4(-1, &status, WUNTRACED, &usage);
+    if (pid == -1)
+    {
+        if (errno == EINTR) { return; }
+
+        // Someone else reaped them, nothing to wait for anymore
+        for (long i = 0; i < num_slots; i++)
+        {
+            if (slots[i].pid && group_output)
+            {
+                close(slots[i].out_fd);
+                close(slots[i].err_fd);
+            }
+            slots[i].pid = 0;
+        }
+        num_running = 0;
+        return;
+    }
+
+    pmap_slot* slot = NULL;
+    for (long i = 0; i < num_slots && !slot; i++)
+    {
+        if (slots[i].pid == pid)
+            slot = &slots[i];
+    }
+
+    if (!slot)
+    {
+        update_process(pid, status, &usage);
+        return;
+    }
+
+    // There's no job to stop, so a stopped child just carries on
+    if (WIFSTOPPED(status))
+    {
+        kill(pid, SIGCONT);
+        return;
+    }
+
+    if (group_output)
+    {
+        fflush(stdout);
+        flush_output(slot->out_fd, STDOUT_FILENO);
+        flush_output(slot->err_fd, STDERR_FILENO);
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status))
+        num_failed++;
+    if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT)
+        interrupted = true;
+
+    slot->pid = 0;
+    if (!--num_running)
+        pmap_pgid = 0;
+}
+
+static int usage_error()
+{
+    fprintf(stderr, "pmap: usage: pmap [-j jobs] [-g] command [args] [::: items]\n");
+    return 2;
+}
+
+// pmap built-in. Runs command once per item with at most -j of them at a time, the number of online CPUs
+// by default. {} in the arguments is replaced by the item, without one the item is the last argument.
+// Items follow ':::', or else are the lines of stdin. -g keeps each command's output together, written once
+// it's done. Exits with the number of commands that failed
+int pmap(int argc, char** argv)
+{
+    num_slots = sysconf(_SC_NPROCESSORS_ONLN);
+    group_output = false;
+
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (!strcmp(argv[i], "--"))
+        {
+            i++;
+            break;
+        }
+
+        if (!strcmp(argv[i], "-g"))
+        {
+            group_output = true;
+            continue;
+        }
+
+        if (strncmp(argv[i], "-j", 2)) { return usage_error(); }
+
+        const char* value = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : "");
+        char* end;
+        num_slots = strtol(value, &end, 10);
+        if (!*value || *end || num_slots <= 0)
+        {
+            fprintf(stderr, "pmap: -j takes a number of jobs\n");
+            return 2;
+        }
+    }
+
+    pmap_items items = {0};
+
+    int separator = i;
+    while (separator < argc && strcmp(argv[separator], ":::")) { separator++; }
+
+    template = argv + i;
+    template_size = separator - i;
+    if (!template_size) { return usage_error(); }
+
+    if (separator < argc)
+    {
+        items.args = argv + separator + 1;
+        items.num_args = argc - separator - 1;
+    }
+    else
+    {
+        items.from_stdin = true;
+    }
+
+    has_placeholder = false;
+    for (int k = 0; k < template_size; k++)
+    {
+        if (strstr(template[k], PMAP_PLACEHOLDER))
+            has_placeholder = true;
+    }
+
+    // More slots than items or than the processes the user may run would only go unused
+    struct rlimit nproc;
+    if (getrlimit(RLIMIT_NPROC, &nproc) == 0 && nproc.rlim_cur != RLIM_INFINITY && (rlim_t)num_slots > nproc.rlim_cur)
+        num_slots = nproc.rlim_cur ? (long)nproc.rlim_cur : 1;
+    if (num_slots > PMAP_MAX_JOBS)
+        num_slots = PMAP_MAX_JOBS;
+    if (!items.from_stdin && num_slots > items.num_args)
+        num_slots = items.num_args ? items.num_args : 1;
+
+    slots = calloc(num_slots, sizeof(*slots));
+    if (!slots)
+    {
+        perror("pmap");
+        return 1;
+    }
+
+    num_running = 0;
+    num_failed = 0;
+    interrupted = false;
+    pmap_pgid = 0;
+    owns_terminal = job_control && isatty(STDIN_FILENO);
+
+    while (!interrupted)
+    {
+        // Every slot is taken, wait for one to free up
+        if (num_running == num_slots)
+        {
+            reap_child();
+            continue;
+        }
+
+        char* item = next_item(&items);
+        if (!item) { break; }
+
+        start_item(item, items.from_stdin);
+    }
+
+    while (num_running)
+        reap_child();
+
+    if (job_control)
+    {
+        if (owns_terminal)
+            tcsetpgrp(STDIN_FILENO, shell_pgid);
+        active_child = -1;
+    }
+
+    // The commands could have left the cursor anywhere
+    cursor_column_known = false;
+
+    free(slots);
+    free(items.buffer);
+    slots = NULL;
+    template = NULL;
+
+    return num_failed > PMAP_MAX_FAILED_STATUS ? PMAP_MAX_FAILED_STATUS : (int)num_failed;
+}
@@ -0,0 +1,370 @@
+#include "../include/redirect.h"
+
+typedef struct redir_operator
+{
+    const char* text;
+    redir_type type;
+    int fd; // Descriptor redirected when the operator isn't preceded by one
+} redir_operator;
+
+static const redir_operator operators[] =
+{
+    { "<",   REDIR_READ,       STDIN_FILENO  },
+    { "<<",  REDIR_HEREDOC,    STDIN_FILENO  },
+    { "<<<", REDIR_HERESTRING, STDIN_FILENO  },
+    { "<>",  REDIR_READ_WRITE, STDIN_FILENO  },
+    { "<&",  REDIR_DUP,        STDIN_FILENO  },
+    { ">",   REDIR_WRITE,      STDOUT_FILENO },
+    { ">>",  REDIR_APPEND,     STDOUT_FILENO },
+    { ">&",  REDIR_DUP,        STDOUT_FILENO },
+};
+
+#define NUM_OPERATORS (sizeof(operators) / sizeof(*operators))
+
+// Flags files are opened with, for the redirections that open one
+static int open_flags(redir_type type)
+{
+    switch (type)
+    {
+        case REDIR_READ:
+            return O_RDONLY;
+        case REDIR_WRITE:
+            return O_WRONLY | O_CREAT | O_TRUNC;
+        case REDIR_APPEND:
+            return O_WRONLY | O_CREAT | O_APPEND;
+        case REDIR_READ_WRITE:
+            return O_RDWR | O_CREAT;
+        default:
+            return -1;
+    }
+}
+
+// Moves a descriptor the shell opened for itself to REDIR_SHELL_FD_MIN or above, where no redirection
+// can name it. Returns the new descriptor, closing fd, or -1 if fd is -1
+int redirect_hide_fd(int fd)
+{
+    if (fd == -1 || fd >= REDIR_SHELL_FD_MIN) { return fd; }
+
+    int high = fcntl(fd, F_DUPFD_CLOEXEC, REDIR_SHELL_FD_MIN);
+    if (high == -1)
+    {
+        perror("fcntl");
+        exit(EXIT_FAILURE);
+    }
+
+    close(fd);
+    return high;
+}
+
+// Turns operator op and the word after it into redirections. &> and &>> stand for two, >file 2>&1.
+// Returns how many were written to redirs, 0 after printing why op or word aren't valid.
+// A here-document's target is its delimiter until the caller reads the lines it ends
+size_t redirect_parse(arena* a, const char* op, const char* word, redirection* redirs)
+{
+    if (!strcmp(op, "&>") || !strcmp(op, "&>>"))
+    {
+        redirs[0] = (redirection){ op[2] ? REDIR_APPEND : REDIR_WRITE, STDOUT_FILENO, word, -1 };
+        redirs[1] = (redirection){ REDIR_DUP, STDERR_FILENO, NULL, STDOUT_FILENO };
+        return 2;
+    }
+
+    const char* p = op;
+    int fd = -1;
+    while (isdigit((unsigned char)*p))
+    {
+        fd = (fd == -1 ? 0 : fd * 10) + (*p++ - '0');
+        if (fd > REDIR_MAX_FD)
+        {
+            fprintf(stderr, "rash: %s: file descriptors above %d can't be redirected\n", op, REDIR_MAX_FD);
+            return 0;
+        }
+    }
+
+    const redir_operator* found = NULL;
+    for (size_t i = 0; i < NUM_OPERATORS && !found; i++)
+    {
+        if (!strcmp(p, operators[i].text))
+            found = &operators[i];
+    }
+
+    if (!found)
+    {
+        fprintf(stderr, "syntax error near symbol %s\n", op);
+        return 0;
+    }
+
+    redirection* r = redirs;
+    r->type = found->type;
+    r->fd = fd == -1 ? found->fd : fd;
+    r->target = word;
+    r->target_fd = -1;
+
+    if (r->type == REDIR_DUP)
+    {
+        char* end;
+        long target_fd = strtol(word, &end, 10);
+
+        if (!strcmp(word, "-"))
+        {
+            r->type = REDIR_CLOSE;
+        }
+        else if (!isdigit((unsigned char)*word) || *end || target_fd > REDIR_MAX_FD)
+        {
+            fprintf(stderr, "rash: %s: bad file descriptor\n", word);
+            return 0;
+        }
+        else
+        {
+            r->target_fd = (int)target_fd;
+        }
+    }
+    else if (r->type == REDIR_HERESTRING)
+    {
+        size_t length = strlen(word);
+        char* text = arena_alloc(a, length + 2);
+        memcpy(text, word, length);
+        text[length] = '\n';
+        text[length + 1] = '\0';
+        r->target = text;
+    }
+
+    return 1;
+}
+
+// Whether any of the redirections points fd somewhere else
+bool redirects_fd(const redirection* redirs, size_t num_redirs, int fd)
+{
+    for (size_t i = 0; i < num_redirs; i++)
+    {
+        if (redirs[i].fd == fd)
+            return true;
+    }
+
+    return false;
+}
+
+// A memfd holding text, positioned at the start for whoever reads it
+static int text_fd(const char* text)
+{
+    int fd = memfd_create("rash heredoc", MFD_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("memfd_create");
+        exit(EXIT_FAILURE);
+    }
+    fd = redirect_hide_fd(fd);
+
+    size_t length = strlen(text);
+    for (size_t written = 0; written < length; )
+    {
+        ssize_t n = write(fd, text + written, length - written);
+        if (n == -1)
+        {
+            if (errno == EINTR) { continue; }
+
+            perror("heredoc write");
+            exit(EXIT_FAILURE);
+        }
+        written += n;
+    }
+
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+// Whether a child with num_other file actions, like its pipe ends, has room for num_redirs redirections
+// too. Checked before any is queued, printing why not
+bool redirect_fits(size_t num_other, size_t num_redirs)
+{
+    if (num_other + num_redirs <= LAUNCH_MAX_ACTIONS) { return true; }
+
+    fprintf(stderr, "rash: too many redirections, a command takes at most %d\n", (int)(LAUNCH_MAX_ACTIONS - num_other));
+    return false;
+}
+
+// Adds the redirections to a child's file actions, after anything already there like a pipe.
+// Files are opened here rather than in the child, so a failure can name the file, and here-documents
+// get a memfd each. The caller closes them all, fds[0, *num_fds), with redirect_close once the child
+// started. fds needs room for num_redirs, and the caller checks the actions fit, see redirect_fits.
+// Returns false after printing why a file couldn't be opened
+bool redirect_spawn(launch_spec* spec, const redirection* redirs, size_t num_redirs, int* fds, size_t* num_fds)
+{
+    *num_fds = 0;
+
+    for (size_t i = 0; i < num_redirs; i++)
+    {
+        const redirection* r = &redirs[i];
+
+        switch (r->type)
+        {
+            case REDIR_DUP:
+                launch_add_dup2(spec, r->target_fd, r->fd);
+                break;
+            case REDIR_CLOSE:
+                launch_add_close(spec, r->fd);
+                break;
+            case REDIR_HEREDOC:
+            case REDIR_HERESTRING:
+                fds[*num_fds] = text_fd(r->target);
+                launch_add_dup2(spec, fds[(*num_fds)++], r->fd);
+                break;
+            default:
+            {
+                int file = open(r->target, open_flags(r->type) | O_CLOEXEC, 0666);
+                if (file == -1)
+                {
+                    fprintf(stderr, "rash: %s: %s\n", r->target, strerror(errno));
+                    return false;
+                }
+
+                fds[*num_fds] = redirect_hide_fd(file);
+                launch_add_dup2(spec, fds[(*num_fds)++], r->fd);
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+void redirect_close(int* fds, size_t num_fds)
+{
+    for (size_t i = 0; i < num_fds; i++)
+        close(fds[i]);
+}
+
+// Moves file onto fd, keeping the shell's own descriptor in *saved for redirect_restore
+void redirect_replace_fd(int file, int fd, int* saved)
+{
+    *saved = fcntl(fd, F_DUPFD_CLOEXEC, REDIR_SHELL_FD_MIN);
+    if (*saved == -1 || dup2(file, fd) == -1)
+    {
+        perror("redirect");
+        exit(EXIT_FAILURE);
+    }
+
+    close(file);
+}
+
+// Keeps a copy of the shell's fd the first time a redirection replaces it
+static void save_fd(int fd, saved_fds* saved)
+{
+    if (saved->fds[fd] != -1) { return; }
+
+    saved->fds[fd] = fcntl(fd, F_DUPFD_CLOEXEC, REDIR_SHELL_FD_MIN);
+    if (saved->fds[fd] == -1)
+    {
+        if (errno != EBADF)
+        {
+            perror("redirect");
+            exit(EXIT_FAILURE);
+        }
+
+        saved->fds[fd] = REDIR_WAS_CLOSED;
+    }
+}
+
+// Points fd at what file refers to, then lets go of file
+static void move_fd(int file, int fd)
+{
+    // fd was closed and open reused it, only the close-on-exec flag is wrong
+    if (file == fd)
+    {
+        fcntl(fd, F_SETFD, 0);
+        return;
+    }
+
+    if (dup2(file, fd) == -1)
+    {
+        perror("redirect");
+        exit(EXIT_FAILURE);
+    }
+    close(file);
+}
+
+// Applies a builtin's redirections to the shell's own descriptors, the way a child would get them.
+// Returns false, with nothing left changed, if a file can't be opened or a descriptor isn't open
+bool redirect_shell(const redirection* redirs, size_t num_redirs, saved_fds* saved)
+{
+    for (int fd = 0; fd <= REDIR_MAX_FD; fd++)
+        saved->fds[fd] = -1;
+
+    // Output buffered before the redirection belongs where stdout pointed then
+    fflush(stdout);
+    fflush(stderr);
+
+    for (size_t i = 0; i < num_redirs; i++)
+    {
+        const redirection* r = &redirs[i];
+
+        // Checked before fd is replaced, 2>&2 has to find it open
+        if (r->type == REDIR_DUP && fcntl(r->target_fd, F_GETFD) == -1)
+        {
+            redirect_restore(saved);
+            fprintf(stderr, "rash: %d: %s\n", r->target_fd, strerror(errno));
+            return false;
+        }
+
+        save_fd(r->fd, saved);
+
+        switch (r->type)
+        {
+            case REDIR_DUP:
+                if (r->target_fd != r->fd && dup2(r->target_fd, r->fd) == -1)
+                {
+                    perror("redirect");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case REDIR_CLOSE:
+                close(r->fd);
+                break;
+            case REDIR_HEREDOC:
+            case REDIR_HERESTRING:
+                move_fd(text_fd(r->target), r->fd);
+                break;
+            default:
+            {
+                int file = open(r->target, open_flags(r->type) | O_CLOEXEC, 0666);
+                if (file == -1)
+                {
+                    int error = errno;
+                    redirect_restore(saved);
+                    fprintf(stderr, "rash: %s: %s\n", r->target, strerror(error));
+                    return false;
+                }
+
+                move_fd(file, r->fd);
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Puts back the descriptors redirect_shell replaced
+void redirect_restore(saved_fds* saved)
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    for (int fd = 0; fd <= REDIR_MAX_FD; fd++)
+    {
+        if (saved->fds[fd] == REDIR_WAS_CLOSED)
+        {
+            close(fd);
+        }
+        else if (saved->fds[fd] != -1)
+        {
+            dup2(saved->fds[fd], fd);
+            close(saved->fds[fd]);
+        }
+
+        saved->fds[fd] = -1;
+    }
+
+    // A write error on the redirected file doesn't stick to the terminal
+    clearerr(stdout);
+    clearerr(stderr);
+}
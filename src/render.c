@@ -0,0 +1,295 @@
+#include "../include/render.h"
+
+static frame screen = {0};
+
+// Everything one update sends to the terminal, written with a single write()
+static char* out = NULL;
+static size_t out_size = 0;
+static size_t out_capacity = 0;
+
+// The line being drawn, in one piece
+static char* next = NULL;
+static size_t next_capacity = 0;
+
+static void reserve(char** buffer, size_t* capacity, size_t size)
+{
+    if (size <= *capacity) { return; }
+
+    size_t new_capacity = *capacity ? *capacity : 256;
+    while (new_capacity < size) { new_capacity <<= 1; }
+
+    char* temp = realloc(*buffer, new_capacity);
+    if (!temp)
+    {
+        perror("render realloc");
+        exit(EXIT_FAILURE);
+    }
+
+    *buffer = temp;
+    *capacity = new_capacity;
+}
+
+static void out_append(const char* s, size_t n)
+{
+    if (!out_size && RENDER_SYNCHRONIZED_UPDATE)
+    {
+        reserve(&out, &out_capacity, 8);
+        memcpy(out, "\033[?2026h", 8);
+        out_size = 8;
+    }
+
+    reserve(&out, &out_capacity, out_size + n);
+    memcpy(out + out_size, s, n);
+    out_size += n;
+}
+
+static void out_printf(const char* format, ...)
+{
+    char sequence[64];
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(sequence, sizeof(sequence), format, args);
+    va_end(args);
+
+    out_append(sequence, (size_t)n);
+}
+
+// Sends the update. Whatever was printed through stdio before it goes out first
+void render_flush()
+{
+    if (!out_size) { return; }
+
+    if (RENDER_SYNCHRONIZED_UPDATE)
+        out_append("\033[?2026l", 8);
+
+    fflush(stdout);
+
+    const char* p = out;
+    size_t left = out_size;
+    while (left)
+    {
+        ssize_t n = write(STDOUT_FILENO, p, left);
+        if (n == -1)
+        {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+
+        p += n;
+        left -= n;
+    }
+
+    out_size = 0;
+}
+
+// Cell of offset i into the line
+static size_t text_cell(size_t i)
+{
+    return screen.prompt_column + screen.prompt_width + i;
+}
+
+static void move_to(size_t cell)
+{
+    size_t width = (size_t)screen.width;
+    size_t row = cell / width, column = cell % width;
+    size_t current_row = screen.cursor / width, current_column = screen.cursor % width;
+
+    if (row < current_row)
+        out_printf("\033[%luA", current_row - row);
+    else if (row > current_row)
+        out_printf("\033[%luB", row - current_row);
+
+    if (column == 0 && current_column != 0)
+        out_append("\r", 1);
+    else if (column > current_column)
+        out_printf("\033[%luC", column - current_column);
+    else if (column < current_column)
+        out_printf("\033[%luD", current_column - column);
+
+    screen.cursor = cell;
+}
+
+// Prints text ending on cell end. A terminal that just filled the last column leaves its cursor there
+// until the next character, so step onto the next row explicitly to keep the cursor where it's expected
+static void print_until(const char* text, size_t n, size_t end)
+{
+    out_append(text, n);
+    screen.cursor = end;
+
+    if (n && end % (size_t)screen.width == 0)
+        out_append("\r\n", 2);
+}
+
+// Starts a new frame with the prompt printed at column of the cursor's row
+void render_prompt(const char* prompt, size_t prompt_width, size_t column)
+{
+    free(screen.prompt);
+    screen.prompt = strdup(prompt);
+    screen.prompt_width = prompt_width;
+    screen.width = win_size_x() > 0 ? win_size_x() : 80;
+    screen.prompt_column = column < (size_t)screen.width ? column : 0;
+    screen.cursor = screen.prompt_column;
+    screen.size = 0;
+    screen.footer_size = 0;
+    screen.drawn = true;
+
+    print_until(prompt, strlen(prompt), text_cell(0));
+    render_flush();
+}
+
+// After the terminal width changes, the old frame's layout is meaningless. Goes back to where the prompt
+// should be and draws it again from scratch. Terminals that reflow their contents move the cursor to where
+// its cell falls at the new width, others leave it where it was, and when the two differ the terminal is asked
+static void redraw_prompt()
+{
+    size_t old_width = (size_t)screen.width;
+    size_t width = win_size_x() > 0 ? (size_t)win_size_x() : 80;
+
+    size_t reflowed_column = screen.cursor % width;
+    size_t kept_column = screen.cursor % old_width < width ? screen.cursor % old_width : width - 1;
+
+    cursor_pos pos;
+    bool reflowed = true;
+    if (reflowed_column != kept_column && query_cursor(&pos, CURSOR_QUERY_TIMEOUT_MS))
+        reflowed = (size_t)pos.x - 1 == reflowed_column;
+
+    // Rows are counted in the width the contents are laid out in now
+    if (reflowed)
+        screen.width = (int)width;
+    else
+        screen.cursor = screen.cursor - screen.cursor % old_width + kept_column;
+
+    move_to(screen.prompt_column < width ? screen.prompt_column : 0);
+    out_append("\033[J", 3);
+
+    screen.width = (int)width;
+    if (screen.prompt_column >= width)
+        screen.prompt_column = 0;
+
+    screen.cursor = screen.prompt_column;
+    screen.size = 0;
+    screen.footer_size = 0;
+
+    print_until(screen.prompt, strlen(screen.prompt), text_cell(0));
+}
+
+// Brings the screen in line with l and the footer rows under it, sending only what changed:
+// an insertion or deletion on a line that fits in one row is one in-place edit, anything else
+// is rewritten from the first changed character. footer rows must fit within the terminal width
+void render_line(const line* l, const char* footer, size_t footer_size)
+{
+    if (!screen.drawn) { return; }
+
+    if (win_size_x() > 0 && win_size_x() != screen.width)
+        redraw_prompt();
+
+    const char* first;
+    const char* second;
+    size_t first_size, second_size;
+    line_segments(l, &first, &first_size, &second, &second_size);
+
+    size_t new_size = first_size + second_size;
+    reserve(&next, &next_capacity, new_size + 1);
+    if (first_size) { memcpy(next, first, first_size); }
+    if (second_size) { memcpy(next + first_size, second, second_size); }
+
+    size_t old_size = screen.size;
+    size_t common = 0;
+    while (common < old_size && common < new_size && screen.text[common] == next[common]) { common++; }
+
+    bool text_changed = common != old_size || common != new_size;
+    bool footer_changed = footer_size != screen.footer_size || (footer_size && memcmp(footer, screen.footer, footer_size));
+    bool footer_erased = false;
+
+    if (text_changed)
+    {
+        size_t suffix = 0;
+        size_t max_suffix = (old_size < new_size ? old_size : new_size) - common;
+        while (suffix < max_suffix && screen.text[old_size - 1 - suffix] == next[new_size - 1 - suffix]) { suffix++; }
+
+        bool one_row = text_cell(old_size > new_size ? old_size : new_size) < (size_t)screen.width;
+
+        if (one_row && suffix && new_size > old_size && suffix == old_size - common)
+        {
+            // Insert characters (ICH), the rest of the row shifts right by itself
+            size_t inserted = new_size - old_size;
+            move_to(text_cell(common));
+            out_printf("\033[%lu@", inserted);
+            out_append(next + common, inserted);
+            screen.cursor += inserted;
+        }
+        else if (one_row && suffix && old_size > new_size && suffix == new_size - common)
+        {
+            // Delete characters (DCH), the rest of the row shifts left
+            move_to(text_cell(common));
+            out_printf("\033[%luP", old_size - new_size);
+        }
+        else
+        {
+            move_to(text_cell(common));
+            print_until(next + common, new_size - common, text_cell(new_size));
+
+            if (new_size < old_size || screen.footer_size)
+            {
+                out_append("\033[J", 3);
+                footer_erased = screen.footer_size > 0;
+            }
+        }
+
+        reserve(&screen.text, &screen.capacity, new_size);
+        memcpy(screen.text, next, new_size);
+        screen.size = new_size;
+    }
+
+    if (footer_changed || footer_erased)
+    {
+        move_to(text_cell(new_size));
+        if (!footer_erased) { out_append("\033[J", 3); }
+
+        if (footer_size)
+        {
+            size_t rows = 1;
+            out_append("\r\n", 2);
+            for (size_t i = 0; i < footer_size; i++)
+            {
+                if (footer[i] == '\n')
+                {
+                    out_append("\033[K\r\n", 5);
+                    rows++;
+                }
+                else
+                {
+                    out_append(footer + i, 1);
+                }
+            }
+            out_append("\033[K\r", 4);
+
+            screen.cursor = (text_cell(new_size) / screen.width + rows) * screen.width;
+        }
+
+        reserve(&screen.footer, &screen.footer_capacity, footer_size);
+        if (footer_size) { memcpy(screen.footer, footer, footer_size); }
+        screen.footer_size = footer_size;
+    }
+
+    move_to(text_cell(l->cursor_pos));
+    render_flush();
+}
+
+// Leaves the line for good, so a command can print below it: moves past its end, clears anything drawn under it,
+// and starts a new row. The next frame starts with render_prompt
+void render_end_line()
+{
+    if (!screen.drawn) { return; }
+
+    move_to(text_cell(screen.size));
+    if (screen.footer_size) { out_append("\033[J", 3); }
+    if (screen.cursor % screen.width) { out_append("\r\n", 2); }
+
+    screen.drawn = false;
+    screen.size = 0;
+    screen.footer_size = 0;
+
+    render_flush();
+}
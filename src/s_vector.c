@@ -27,28 +27,6 @@ void add_string(s_vector* lines, char* buffer, bool copy)
     lines->size++;
 }
 
-// add_string but works on input buffer of variable length where actual string size might not match
-void buf_add_string(s_vector* lines, char* buffer, ssize_t nread)
-{
-    if (buffer && !*buffer) { return; }
-
-    if (lines->size == lines->capacity)
-    {
-        lines->capacity = (lines->capacity == 0) ? 1 : lines->capacity << 1;
-        char** temp = realloc(lines->data, sizeof(*lines->data) * lines->capacity);
-        if (!temp)
-        {
-            // TODO: Free on exit?
-            perror("realloc");
-            exit(EXIT_FAILURE);
-        }
-        lines->data = temp;
-    }
-
-    lines->data[lines->size] = buffer ? strndup(buffer, nread) : NULL;
-    lines->size++;
-}
-
 void erase(s_vector* vec, int pos)
 {
     if (pos < 0 || pos >= (int)vec->size) { fprintf(stderr, "erase: invalid range\n"); exit(EXIT_FAILURE); }
@@ -7,22 +7,60 @@ s_vector paths = {NULL, 0, 0};
 s_vector dir_history = {NULL, 0, 0};
 size_t current_dir = 0;
 
+// Owns the tokens and commands of the line being run
+arena line_arena = {0};
+
 s_vector line_history = {NULL, 0, 0};
 ssize_t line_history_search_index = -1;
 line temp_line = {0};
 bool search_initiated = false;
 
-size_t prompt_start_y = 0;
-size_t prompt_end_y = 0;
-size_t prompt_length = 0;
+// Reverse-i-search state. The interactive line holds the query while it's active
+bool reverse_searching = false;
+line saved_search_line = {0}; // What was being typed before the search, restored on cancel
+fuzzy_result search_results[FUZZY_MAX_RESULTS];
+size_t num_search_results = 0;
+size_t search_selected = 0;
+
+// Set by SIGINT while no command is running, the line being edited is dropped
+volatile sig_atomic_t line_interrupted = 0;
+
+// Candidates shown under the line after a completion that couldn't pick one, until the next key
+char* completion_listing = NULL;
+size_t completion_listing_size = 0;
+size_t completion_listing_capacity = 0;
+
+// A completion is waiting for its directory to be read, or for the command names. Any key drops it
+bool completion_pending = false;
+
+// Where here-documents read their lines from: the script, or the terminal
+line_reader heredoc_input = NULL;
+char* terminal_line = NULL;
+size_t terminal_line_capacity = 0;
+
+int last_status = 0;
+
+// When the keys being handled were read, for measuring how long until they're on the screen
+uint64_t keystroke_start = 0;
+
+// Commands that take at least this long get their time reported, 0 for none
+long time_threshold_ms = 0;
 
-pid_t active_child = -1;
+bool interactive = true;
+char* script_path = NULL;
 
 void clean_up_mem()
 {
     free_s_vector(&paths);
-    free_s_vector(&line_history);
+    history_free(&line_history);
     free_s_vector(&dir_history);
+    hash_free(&cmd_hash);
+    free_jobs();
+    arena_free(&line_arena);
+    input_free();
+    completion_free();
+    free(completion_listing);
+    free(terminal_line);
 }
 
 void print_command(const command* command, const s_vector* tokens)
@@ -34,9 +72,11 @@ void print_command(const command* command, const s_vector* tokens)
         printf("\targ %lu: %s\n", j, tokens->data[j]);
     }
 
-    if (command->stdin_redir) { printf("\n\tfn: %s\n", command->stdin_redir); }
-    if (command->stdout_redir) { printf("\n\tfn: %s\n", command->stdout_redir); }
-    if (command->stderr_redir) { printf("\n\tfn: %s\n", command->stderr_redir); }
+    for (size_t j = 0; j < command->num_redirs; j++)
+    {
+        const redirection* r = &command->redirs[j];
+        printf("\n\tredir %d (type %d): %s\n", r->fd, r->type, r->target ? r->target : "");
+    }
 
     printf("\n");
 }
@@ -71,6 +111,7 @@ void add_path(s_vector* paths, char* path_name)
                 if (!already_has_path)
                 {
                     add_string(paths, abs_path, false);
+                    hash_validate(&cmd_hash, paths, true);
                 }
                 else
                 {
@@ -134,130 +175,297 @@ int file_status(char* path_name)
     }
 }
 
-// Runs an executable given args. If original command contains slashes, it's assumed to be relative or absolute path executable. Otherwise, the command is assumed to be some executable found in PATH
-void execute_bin(const command* command, s_vector* tokens)
+// Finds the executable for a command name. If the name contains slashes, it's assumed to be a relative or absolute path to an executable. Otherwise, the command is assumed to be some executable found in PATH
+// Prints why and returns NULL if there's nothing to run
+const char* resolve_executable(char* name)
 {
-    bool contains_slashes = strchr(tokens->data[command->args_start], '/');
-    char* path = NULL;
-
-    if (contains_slashes)
+    if (strchr(name, '/'))
     {
-        path = realpath(tokens->data[command->args_start], NULL);
-        if (!path)
+        // execv takes relative paths as is, so a single stat is enough to report the usual errors
+        struct stat s;
+        if (stat(name, &s) == -1)
         {
             if (errno == ENOENT)
             {
-                printf("%s: no such file or directory\n", tokens->data[command->args_start]);
+                printf("%s: no such file or directory\n", name);
             }
             else
             {
-                fprintf(stderr, "%s: ", tokens->data[command->args_start]);
-                perror("realpath");
+                fprintf(stderr, "%s: ", name);
+                perror("stat");
             }
 
-            return;
+            return NULL;
         }
 
-        int fs = file_status(path);
-
-        if (fs == 1)
+        if (S_ISDIR(s.st_mode))
         {
-            free(path);
-            printf("%s: is a directory\n", tokens->data[command->args_start]);
-            return;
+            printf("%s: is a directory\n", name);
+            return NULL;
         }
 
-        if (access(path, X_OK))
+        if (access(name, X_OK))
         {
-            fprintf(stderr, "%s: ", tokens->data[command->args_start]);
+            fprintf(stderr, "%s: ", name);
             perror("access");
-            free(path);
+            return NULL;
+        }
+
+        return name;
+    }
+
+    const char* path = hash_lookup(&cmd_hash, &paths, name);
+    if (!path)
+        printf("%s: command not found\n", name);
+
+    return path;
+}
+
+// Joins the arguments of every stage of a pipeline, for job listings
+char* command_text(const command* command, s_vector* tokens)
+{
+    size_t length = 1;
+    for (const struct command* stage = command; stage; stage = stage->pipe)
+    {
+        for (size_t i = stage->args_start; i <= stage->args_end; i++)
+            length += strlen(tokens->data[i]) + 3;
+    }
+
+    char* text = malloc(length);
+    if (!text)
+    {
+        perror("command_text malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    char* end = text;
+    for (const struct command* stage = command; stage; stage = stage->pipe)
+    {
+        for (size_t i = stage->args_start; i <= stage->args_end; i++)
+        {
+            end = stpcpy(end, tokens->data[i]);
+            if (i != stage->args_end)
+                *end++ = ' ';
+        }
+
+        if (stage->pipe)
+            end = stpcpy(end, " | ");
+    }
+    *end = '\0';
+
+    return text;
+}
+
+// Runs a builtin in the shell with its redirections applied to the shell's own descriptors while it runs
+static void run_builtin(const builtin* b, const command* command, s_vector* tokens)
+{
+    saved_fds saved;
+    if (!redirect_shell(command->redirs, command->num_redirs, &saved))
+    {
+        last_status = 1;
+        return;
+    }
+
+    // argv has to be NULL terminated while the builtin runs
+    char* tmp = tokens->data[command->args_end + 1];
+    tokens->data[command->args_end + 1] = NULL;
+
+    builtin_line_open = false;
+    last_status = b->run(num_args(command), tokens->data + command->args_start);
+
+    tokens->data[command->args_end + 1] = tmp;
+    redirect_restore(&saved);
+
+    // Output left unfinished on the terminal moved the cursor off the start of a row
+    if (builtin_line_open && !redirects_fd(command->redirs, command->num_redirs, STDOUT_FILENO))
+        cursor_column_known = false;
+}
+
+// Runs a command, or every stage of a pipeline when command->pipe is set.
+// All stages are started before any wait, connected with pipes, and put in one process group.
+// Foreground jobs get the terminal until they finish or stop, background jobs ('&') are left running
+void execute_bin(const command* command, s_vector* tokens)
+{
+    size_t num_stages = 0;
+    const struct command* last = command;
+    for (const struct command* stage = command; stage; stage = stage->pipe)
+    {
+        num_stages++;
+        last = stage;
+    }
+
+    // A builtin ending a foreground pipeline runs in the shell reading the pipe, like bash's lastpipe
+    const builtin* last_builtin = command->pipe && !command->bg ? builtin_find(tokens->data[last->args_start]) : NULL;
+    size_t num_processes = last_builtin ? num_stages - 1 : num_stages;
+
+    pid_t* pids = malloc(num_stages * sizeof(*pids));
+    const char** stage_paths = malloc(num_stages * sizeof(*stage_paths));
+    if (!pids || !stage_paths)
+    {
+        perror("pipeline malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t num_resolved = 0;
+    for (const struct command* stage = command; num_resolved < num_processes; stage = stage->pipe)
+    {
+        uint64_t start = stats_now();
+        stage_paths[num_resolved] = resolve_executable(tokens->data[stage->args_start]);
+        stats_record_since(STAT_RESOLVE, start);
+
+        if (!stage_paths[num_resolved++])
+        {
+            free(stage_paths);
+            free(pids);
+            last_status = 127;
             return;
         }
     }
-    else
+
+    bool foreground = !command->bg;
+
+    fflush(stdout);
+
+    pid_t pgid = 0;
+    size_t num_started = 0;
+    int stdin_fd = -1; // Read end of the previous stage's pipe
+
+    for (const struct command* stage = command; num_started < num_processes; stage = stage->pipe)
     {
-        for (size_t i = 0; i < paths.size; i++)
+        int pipe_fds[2] = {-1, -1};
+        if (stage->pipe && pipe2(pipe_fds, O_CLOEXEC) == -1)
         {
-            if (asprintf(&path, "%s/%s", paths.data[i], tokens->data[command->args_start]) == -1)
-            {
-                perror("asprintf");
-                exit(EXIT_FAILURE);
-            }
+            perror("pipe2");
+            break;
+        }
+
+        // A stage's <&3 mustn't reach another stage's pipe
+        pipe_fds[0] = redirect_hide_fd(pipe_fds[0]);
+        pipe_fds[1] = redirect_hide_fd(pipe_fds[1]);
+
+        launch_spec spec = {0};
+        spec.path = stage_paths[num_started];
+        spec.argv = tokens->data + stage->args_start;
+        spec.set_pgid = job_control;
+        spec.pgid = pgid;
+        // The shell keeps the terminal while a builtin at the end of the pipeline runs
+        spec.foreground = job_control && foreground && !pgid && !last_builtin;
+
+        int* redir_fds = arena_alloc(&line_arena, (stage->num_redirs + 1) * sizeof(*redir_fds));
+        size_t num_redir_fds = 0;
+        pid_t pid = -1;
+
+        bool stdin_action = stdin_fd != -1 || (!foreground && !job_control);
+        if (redirect_fits(stdin_action + (pipe_fds[1] != -1), stage->num_redirs))
+        {
+            // The pipe ends are close-on-exec, only the dup2'd copies survive in the child
+            if (stdin_fd != -1)
+                launch_add_dup2(&spec, stdin_fd, STDIN_FILENO);
+            else if (stdin_action)
+                launch_add_open(&spec, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+
+            if (pipe_fds[1] != -1)
+                launch_add_dup2(&spec, pipe_fds[1], STDOUT_FILENO);
 
+            // Redirections come after the pipe and win over it, so 2>&1 sends stderr down the pipe too
+            if (redirect_spawn(&spec, stage->redirs, stage->num_redirs, redir_fds, &num_redir_fds))
             {
-                break;
-            }
+                // argv has to be NULL terminated while the child starts
+                char* tmp = tokens->data[stage->args_end + 1];
+                tokens->data[stage->args_end + 1] = NULL;
 
-            free(path);
-            path = NULL;
+                // Either backend returns once the child runs the new program
+                uint64_t spawn_start = stats_now();
+                pid = launch(&spec);
+                stats_record_since(STAT_SPAWN, spawn_start);
+
+                tokens->data[stage->args_end + 1] = tmp;
+            }
         }
 
-        if (!path)
+        // The child has its own copies of the redirected files and here-documents now
+        redirect_close(redir_fds, num_redir_fds);
+
+        if (stdin_fd != -1)
+            close(stdin_fd);
+        if (pipe_fds[1] != -1)
+            close(pipe_fds[1]);
+        stdin_fd = pipe_fds[0];
+
+        if (pid == -1)
+            break;
+
+        if (!pgid)
         {
-            printf("%s: command not found\n", tokens->data[command->args_start]);
-            return;
+            pgid = job_control ? pid : shell_pgid;
+
+            // The child does this too, whichever runs first wins the race against the child reading the terminal
+            if (spec.foreground)
+                tcsetpgrp(STDIN_FILENO, pgid);
         }
 
+        pids[num_started++] = pid;
     }
 
-    // Execute command
-    active_child = fork();
-    // Some error code for SIGCHLD supposed to be here?
+    int builtin_status = -1;
+    job* j = num_started ? job_add(pgid, pids, num_started, command_text(command, tokens)) : NULL;
 
-    switch(active_child)
+    // The job is known before the builtin runs, so a builtin reaping children passes the stages' statuses on
+    if (last_builtin && num_started == num_processes && stdin_fd != -1)
     {
-        case -1:
-            perror("fork");
+        int saved_stdin;
+        redirect_replace_fd(stdin_fd, STDIN_FILENO, &saved_stdin);
+        stdin_fd = -1;
+
+        run_builtin(last_builtin, last, tokens);
+        builtin_status = last_status;
+
+        if (dup2(saved_stdin, STDIN_FILENO) == -1)
+        {
+            perror("dup2");
             exit(EXIT_FAILURE);
-        case 0:
-            {
-                // Change file descriptor if needed
-                if (command->stdin_redir)
-                {
-                    if (!freopen(command->stdin_redir, "r", stdin))
-                    {
-                        perror("freopen");
-                        exit(EXIT_FAILURE);
-                    }
-                }
+        }
+        close(saved_stdin);
+    }
 
-                if (command->stdout_redir)
-                {
-                    if (!freopen(command->stdout_redir, "w", stdout))
-                    {
-                        perror("freopen");
-                        exit(EXIT_FAILURE);
-                    }
-                }
+    if (stdin_fd != -1)
+        close(stdin_fd);
 
-                // Execute the command
-                char* tmp = tokens->data[command->args_end + 1];
-                tokens->data[command->args_end + 1] = NULL;
+    if (j)
+    {
+        if (foreground)
+        {
+            uint64_t run_start = stats_now();
+            last_status = job_foreground(j, false);
+            stats_record_since(STAT_RUN, run_start);
 
-                if (execv(path, tokens->data + command->args_start) == -1)
-                {
-                    perror("execv");
-                    exit(EXIT_FAILURE);
-                }
-                tokens->data[command->args_end] = tmp;
-            }
-            break;
-        default:
-            wait(NULL);
-            active_child = -1;
+            // The pipeline's status is its last stage's
+            if (builtin_status != -1)
+                last_status = builtin_status;
+        }
+        else
+        {
+            if (job_control)
+                printf("[%d] %d\n", j->id, pids[num_started - 1]);
+            last_status = 0;
+        }
+    }
+    else
+    {
+        if (job_control && foreground)
+            tcsetpgrp(STDIN_FILENO, shell_pgid);
+        last_status = 127;
     }
 
-    free(path);
+    free(stage_paths);
+    free(pids);
 }
 
 // change directory built-in. If only 1 argument (i.e 'cd'), go to home
 // If 2 arguments, change directory of process to relative or absolute path specified by 2nd arg
-void cd(const command* command, s_vector* tokens)
+int cd(int argc, char** argv)
 {
-    int num_cd_args = num_args(command);
-
-    switch (num_cd_args)
+    switch (argc)
     {
         case 1:
             // cd to home
@@ -266,7 +474,7 @@ void cd(const command* command, s_vector* tokens)
             break;
         case 2:
         {
-            char* clean_path = realpath(tokens->data[command->args_end], NULL);
+            char* clean_path = realpath(argv[1], NULL);
             if (clean_path)
             {
                 // printf("clean_path: %s\n", clean_path);
@@ -276,8 +484,9 @@ void cd(const command* command, s_vector* tokens)
                 {
                     case 0:
                         // Does this ever happen?
-                        printf("cd: %s: invalid path\n", tokens->data[command->args_end]);
-                        break;
+                        printf("cd: %s: invalid path\n", argv[1]);
+                        free(clean_path);
+                        return 1;
                     case 1:
                         if (chdir(clean_path) == -1)
                         {
@@ -304,15 +513,17 @@ void cd(const command* command, s_vector* tokens)
 
                         break;
                     case 2:
-                        printf("cd: %s: not a directory\n", tokens->data[command->args_end]);
-                        break;
+                        printf("cd: %s: not a directory\n", argv[1]);
+                        free(clean_path);
+                        return 1;
                 }
             }
             else
             {
                 if (errno == ENOENT)
                 {
-                    printf("cd: %s: invalid path\n", tokens->data[command->args_end]);
+                    printf("cd: %s: invalid path\n", argv[1]);
+                    return 1;
                 }
                 else
                 {
@@ -325,343 +536,303 @@ void cd(const command* command, s_vector* tokens)
         }
         default:
             printf("cd: too many arguments\n");
-            break;
+            return 1;
     }
-}
 
-// Takes parsed command and decides what to do with it
-void handle_command(const command* command, s_vector* tokens)
-{
-    if (num_args(command) != 0)
-    {
-        char* first_arg = tokens->data[command->args_start];
-
-        if      (!strcmp("exit"  , first_arg)) { exit(0); }
-        else if (!strcmp("cd"    , first_arg)) { cd(command, tokens); }
-        else if (!strcmp("prevd" , first_arg)) { prevd(command); }
-        else if (!strcmp("nextd" , first_arg)) { nextd(command); }
-        else if (!strcmp("dirh"  , first_arg)) { dirh(command); }
-        else if (!strcmp("path"  , first_arg)) { path(command, tokens); }
-        else                                   { execute_bin(command, tokens); }
-    }
+    return 0;
 }
 
-void print_prompt()
+static long elapsed_since(const struct timespec* start)
 {
-    printf("\033[1;32m");
-    printf("rash:");
-    printf("\033[1;34m");
-    printf("%s> ", dir_history.data[current_dir]);
-    printf("\033[0m");
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1000000000L + (now.tv_nsec - start->tv_nsec);
 }
 
-void refresh_prompt(bool flush)
+// Takes parsed command and decides what to do with it. Commands slower than the time threshold get reported
+void handle_command(const command* command, s_vector* tokens)
 {
-    cursor_pos pos = get_cursor();
-    prompt_start_y = pos.y;
-
-    print_prompt();
+    if (num_args(command) == 0) { return; }
 
-    if (flush)
-        fflush(stdout);
-
-    pos = get_cursor();
-    prompt_end_y = pos.y;
-
-
-    // TODO: eventually move away from hardcoding the username length through using env to retrieve it
-    prompt_length = 7 + strlen(dir_history.data[current_dir]) + 1;
+    if (!strcmp("time", tokens->data[command->args_start]))
+    {
+        time_builtin(command, tokens);
+    }
+    else if (time_threshold_ms)
+    {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        memset(&last_job_usage, 0, sizeof(last_job_usage));
 
-    prompt_end_y = prompt_start_y + (prompt_length / win_size_x()); 
-}
+        run_command(command, tokens);
 
-void read_line(char** buffer, size_t* size, ssize_t* nread)
-{
-    if ((*nread = getline(buffer, size, stdin)) != -1)
-    {
-        // If read line isn't just a newline, add it to the line_history s_vector
-        if (**buffer != '\n')
+        long elapsed_ns = elapsed_since(&start);
+        if (elapsed_ns >= time_threshold_ms * 1000000L)
         {
-            buf_add_string(&line_history, *buffer, *nread);
+            char* text = command_text(command, tokens);
+            fprintf(stderr, "rash: %s took longer than %ldms\n", text, time_threshold_ms);
+            free(text);
+
+            print_usage(elapsed_ns, &last_job_usage);
         }
     }
     else
     {
-        perror("getline");
-        exit(EXIT_FAILURE);
+        run_command(command, tokens);
     }
 }
 
-typedef enum DELIM
+// Runs a builtin in the shell, anything else in a child process. Pipeline stages get a process, but for a builtin ending one
+void run_command(const command* command, s_vector* tokens)
 {
-    ALPHANUMERIC,
-    WHITESPACE,
-    PIPE,
-    OUT_REDIR,
-    IN_REDIR,
-    SEMI_COLON,
-    AMPERSAND,
-    QUOTE,
-    DOUBLE_QUOTE,
-} DELIM;
+    if (num_args(command) == 0) { return; }
+
+    const builtin* b = command->pipe ? NULL : builtin_find(tokens->data[command->args_start]);
+    if (b)
+        run_builtin(b, command, tokens);
+    else
+        execute_bin(command, tokens);
+}
 
-static const char* const delim_strings[] =
+// Returns the prompt, valid until the next call. width is set to the number of cells it takes up
+const char* build_prompt(size_t* width)
 {
-    "ALPHANUMERIC",
-    "WHITESPACE",
-    "PIPE",
-    "OUT_REDIR",
-    "IN_REDIR",
-    "SEMI_COLON",
-    "AMPERSAND",
-    "QUOTE",
-    "DOUBLE_QUOTE",
-};
+    static char* prompt = NULL;
 
+    free(prompt);
+    if (asprintf(&prompt, "\033[1;32mrash:\033[1;34m%s> \033[0m", dir_history.data[current_dir]) == -1)
+    {
+        perror("asprintf");
+        exit(EXIT_FAILURE);
+    }
 
-DELIM delimiter(char c)
-{
-    if (c == ' ' || c == '\t' || c == '\n' || c == '\0') { return WHITESPACE; }
-    else if (c == '|')  { return PIPE; }
-    else if (c == '>')  { return OUT_REDIR; }
-    else if (c == '<')  { return IN_REDIR; }
-    else if (c == ';')  { return SEMI_COLON; }
-    else if (c == '&')  { return AMPERSAND; }
-    else if (c == '\'') { return QUOTE; }
-    else if (c == '"')  { return DOUBLE_QUOTE; }
-    else { return ALPHANUMERIC; }
+    // TODO: eventually move away from hardcoding the username length through using env to retrieve it
+    *width = 7 + strlen(dir_history.data[current_dir]);
+
+    return prompt;
 }
 
-bool tokenize(s_vector* tokens, char* buffer, ssize_t nread)
+// Starts a new frame with the prompt where the cursor is. The terminal is only asked for the column
+// when something else had it since the last prompt. Without an answer the prompt goes on a row of its own
+void refresh_prompt()
 {
-    if (nread == 1) { return false; }
-
-    // Split input into discrete tokens in O(n) pass
-    ssize_t token_start = 0;
-    char replace = '\0';
-    DELIM previous_delim = WHITESPACE;
-    DELIM current_delim = WHITESPACE;
-    bool need_closing_delim = false;
-
-    for (int i = 0; i < nread; i++)
+    size_t column = 0;
+    if (!cursor_column_known)
     {
-        current_delim = delimiter(buffer[i]);
+        fflush(stdout);
 
-        if (current_delim == QUOTE || current_delim == DOUBLE_QUOTE)
-        {
-            if (!need_closing_delim)
-            {
-                previous_delim = current_delim;
-                need_closing_delim = true;
-                token_start = (ssize_t)i + 1;
-            }
-            else if (previous_delim == current_delim)
-            {
-                // Replace current position with null terminating
-                buffer[i] = '\0';
+        cursor_pos pos;
+        if (query_cursor(&pos, CURSOR_QUERY_TIMEOUT_MS) && pos.x > 0)
+            column = (size_t)pos.x - 1;
+        else
+            fputs("\r\n", stdout);
 
-                // Copy token to tokens
-                if (i != token_start)
-                    add_string(tokens, strndup(buffer + token_start, i - token_start), false);
-                else // Empty string
-                    add_string(tokens, "", true);
+        cursor_column_known = true;
+    }
 
-                // Add back original character
-                buffer[i] = ' ';
+    size_t width;
+    const char* prompt = build_prompt(&width);
 
-                token_start = (ssize_t)i + 1;
-                previous_delim = WHITESPACE;
+    render_prompt(prompt, width, column);
+}
 
-                need_closing_delim = false;
-            }
-        }
-        else if (!need_closing_delim)
-        {
-            if (current_delim != previous_delim)
-            {
-                if (previous_delim != WHITESPACE)
-                {
-                    // Replace current position with null terminating
-                    replace = buffer[i];
-                    buffer[i] = '\0';
+// Reads the lines of a here-document up to the one holding only its delimiter, which r->target is until
+// then, and makes them the target. The lines come after the one being run, from heredoc_input
+static bool read_heredoc(redirection* r)
+{
+    if (!heredoc_input)
+    {
+        fprintf(stderr, "rash: here-document without input to read it from\n");
+        return false;
+    }
 
-                    // Copy token to tokens
-                    char* token = strndup(buffer + token_start, i - token_start);
-                    add_string(tokens, token, false);
+    const char* delimiter = r->target;
+    size_t delimiter_length = strlen(delimiter);
 
-                    // Add back original character
-                    buffer[i] = replace;
+    char* body = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
 
-                }
+    while (true)
+    {
+        size_t length;
+        char* line = heredoc_input(&length);
+        if (!line)
+        {
+            fprintf(stderr, "rash: here-document ended by end of input, wanted '%s'\n", delimiter);
+            break;
+        }
 
-                token_start = (ssize_t)i;
-                previous_delim = current_delim;
-            }
-            else
+        size_t text_length = length && line[length - 1] == '\n' ? length - 1 : length;
+        if (text_length == delimiter_length && !memcmp(line, delimiter, text_length)) { break; }
+
+        if (size + length + 1 > capacity)
+        {
+            capacity = (size + length + 1) << 1;
+            char* temp = realloc(body, capacity);
+            if (!temp)
             {
-                if (current_delim == WHITESPACE)
-                {
-                    token_start++;
-                }
+                perror("heredoc realloc");
+                exit(EXIT_FAILURE);
             }
+            body = temp;
         }
-    }
 
-    if (need_closing_delim)
-    {
-        fprintf(stderr, "missing closing delimiter: %s\n", delim_strings[previous_delim]);
-        free_s_vector(tokens);
-        return false;
+        memcpy(body + size, line, length);
+        size += length;
     }
 
-    if (!tokens->size) { return false; }
-    else
-    {
-        // printf("Tokens size: %lu\nTokens cap: %lu\n", tokens->size, tokens->capacity);
-        //
-        // for (size_t i = 0; i < tokens->size; i++)
-        // {
-        //     if (tokens->data[i])
-        //         printf("%lu: %s\n", i, tokens->data[i]);
-        // }
+    r->target = arena_strndup(&line_arena, body ? body : "", size);
+    free(body);
 
-        return true;
-    }
-    printf("tokenized\n");
+    return true;
 }
 
-bool parse_tokens(s_vector* tokens)
+// Groups tokens into commands without running them. Words are terminated in place and stay that way
+// until restore_tokens, which a syntax error does right away. Everything comes from line_arena
+bool parse_commands(token_vector* tokens, char* buffer, s_vector* words, command** commands, size_t* num_commands)
 {
-    // Use calloc so struct members are 0-initialized
-    command* commands = calloc(tokens->size, sizeof(*commands));
+    uint64_t parse_start = stats_now();
+
+    terminate_tokens(&line_arena, tokens, buffer, words);
+
+    // Zero-initialized, and released along with the tokens once the line is done
+    *commands = arena_calloc(&line_arena, tokens->size, sizeof(**commands));
+
+    // Every redirection takes at least two tokens and makes at most two, so this holds the line's.
+    // A command's own are the ones written between its first and last word, one run of the array
+    redirection* redirs = arena_alloc(&line_arena, tokens->size * sizeof(*redirs));
+    size_t num_redirs = 0;
 
     bool done_taking_args = false;
+    bool has_args = false;
     size_t current_command = 0;
+    size_t pipeline_start = 0;
     size_t arg_start = 0;
 
     for (size_t i = 0; i < tokens->size; i++)
     {
-        int redir = 0;
+        DELIM kind = tokens->data[i].kind;
 
-        if ((!strcmp("<", tokens->data[i]) )||
-            (!strcmp(">", tokens->data[i]) && (redir = 1)) ||
-            (!strcmp("2>", tokens->data[i]) && (redir = 2)))
+        bool is_redirection = kind == IN_REDIR || kind == OUT_REDIR;
+
+        if (!is_redirection && kind != ALPHANUMERIC && tokens->data[i].length > 1)
         {
+            fprintf(stderr, "syntax error near symbol %.*s\n", (int)tokens->data[i].length, buffer + tokens->data[i].offset);
+            goto syntax_error;
+        }
 
-            printf("strcmp found redir: %s", tokens->data[i]);
+        if (is_redirection)
+        {
             if (i == 0)
             {
-                fprintf(stderr, "syntax error near symbol %s: unexpected redirection\n", tokens->data[i]);
+                fprintf(stderr, "syntax error near symbol %s: unexpected redirection\n", words->data[i]);
                 goto syntax_error;
             }
             else
             {
-                if (i + 1 < tokens->size)
+                if (i + 1 < tokens->size && tokens->data[i + 1].kind == ALPHANUMERIC)
                 {
                     done_taking_args = true;
 
-                    switch (redir)
-                    {
-                        case 0:
-                            (commands + current_command)->stdin_redir = tokens->data[i++ + 1];
-                            break;
-                        case 1:
-                            (commands + current_command)->stdout_redir = tokens->data[i++ + 1];
-                            break;
-                        case 2:
-                            (commands + current_command)->stderr_redir = tokens->data[i++ + 1];
-                            break;
-                    }
+                    size_t added = redirect_parse(&line_arena, words->data[i], words->data[i + 1], redirs + num_redirs);
+                    if (!added) { goto syntax_error; }
+
+                    if (redirs[num_redirs].type == REDIR_HEREDOC && !read_heredoc(&redirs[num_redirs]))
+                        goto syntax_error;
+
+                    command* current = *commands + current_command;
+                    if (!current->num_redirs)
+                        current->redirs = redirs + num_redirs;
+
+                    current->num_redirs += added;
+                    num_redirs += added;
+                    i++;
                 }
                 else
                 {
-                    fprintf(stderr, "syntax error near %s: redirection missing file\n", tokens->data[i]);
+                    fprintf(stderr, "syntax error near %s: redirection missing file\n", words->data[i]);
                     goto syntax_error;
                 }
             }
         }
-        else if (!strcmp(";", tokens->data[i]))
+        else if (kind == SEMI_COLON || kind == PIPE || kind == AMPERSAND)
         {
+            bool is_pipe = kind == PIPE;
+
+            if (!has_args || (is_pipe && i + 1 == tokens->size))
+            {
+                fprintf(stderr, "syntax error near symbol %s\n", words->data[i]);
+                goto syntax_error;
+            }
+
+            // Pipeline stages are stored right after the command feeding them
+            if (is_pipe)
+                (*commands + current_command)->pipe = *commands + current_command + 1;
+            else if (kind == AMPERSAND)
+                (*commands + pipeline_start)->bg = true;
+
             done_taking_args = false;
+            has_args = false;
             current_command++;
             arg_start = i + 1;
+
+            if (!is_pipe)
+                pipeline_start = current_command;
         }
         else
         {
             if (!done_taking_args)
             {
-                (commands + current_command)->args_start = arg_start;
-                (commands + current_command)->args_end = i;
+                (*commands + current_command)->args_start = arg_start;
+                (*commands + current_command)->args_end = i;
+                has_args = true;
             }
             else
             {
-                fprintf(stderr, "%s: unexpected argument\n", tokens->data[i]);
+                fprintf(stderr, "%s: unexpected argument\n", words->data[i]);
                 goto syntax_error;
             }
         }
     }
 
-    add_string(tokens, NULL, false);
-
-    for (size_t i = 0; i <= current_command; i++)
-    {
-        // print_command(&commands[i], tokens);
-        handle_command(&commands[i], tokens);
-    }
-
-    free_s_vector(tokens);
-    free(commands);
+    // A trailing ';' doesn't start another command
+    *num_commands = has_args ? current_command + 1 : current_command;
 
+    stats_record_since(STAT_PARSE, parse_start);
     return true;
 
     syntax_error:
-        free_s_vector(tokens);
-        free(commands);
+        restore_tokens(tokens, buffer);
         return false;
 }
 
-bool is_alpha_numeric_symbolic(char c)
+// Groups tokens into commands and runs them. Words are terminated in place for the duration of the run,
+// the buffer is left as it was afterwards
+bool parse_tokens(token_vector* tokens, char* buffer)
 {
-    return (c >= 32 && c <= 126);
-}
+    s_vector words = {0};
+    command* commands;
+    size_t num_commands;
+    if (!parse_commands(tokens, buffer, &words, &commands, &num_commands)) { return false; }
 
-
-void refresh_interactive_line()
-{
-    int interactive_line_start_y = prompt_end_y;
-    if (interactive_line_start_y > win_size_y())
+    for (size_t i = 0; i < num_commands; i++)
     {
-        interactive_line_start_y = win_size_y();
-        prompt_start_y--;
-        prompt_end_y--;
-    }
-    int interactive_line_start_x = prompt_length % (win_size_x());
+        // print_command(&commands[i], &words);
+        handle_command(&commands[i], &words);
 
-    move_cursor(interactive_line_start_y, interactive_line_start_x);
-
-    // erase from cursor to end of screen
-    printf("\033[J");
-
-    printf("%.*s", (int)interactive_line.size, interactive_line.data);
-
-    int raw_cursor_displacement_x = interactive_line_start_x + (int)interactive_line.cursor_pos;
-    int final_cursor_x = (raw_cursor_displacement_x - 1) % (win_size_x()) + 1;
-    int final_cursor_y = interactive_line_start_y + ((raw_cursor_displacement_x - 1) / win_size_x());
-
-
-    if (
-            interactive_line_start_y + (((int)interactive_line.size + interactive_line_start_x - 1) / win_size_x()) == win_size_y() + 1
-        )
-    {
-        printf("\n");
-        // final_cursor_y = win_size_y();
-        final_cursor_y--;
-        prompt_start_y--;
-        prompt_end_y--;
+        // The rest of a pipeline was run along with its first command
+        while (commands[i].pipe) { i++; }
     }
-    move_cursor(final_cursor_y, final_cursor_x);
 
-    fflush(stdout);
+    restore_tokens(tokens, buffer);
+    return true;
+}
+
+void refresh_interactive_line()
+{
+    render_line(&interactive_line, completion_listing, completion_listing_size);
 }
 
 
@@ -682,171 +853,124 @@ void print_key_info(char* buf, int read_bytes)
     printf("\n");
 }
 
+// Tokenizes and runs one line of input. length includes the trailing newline or terminator
+bool execute_line(char* buffer, size_t length)
+{
+    token_vector tokens = {0};
+
+    uint64_t start = stats_now();
+    bool tokenized = tokenize(&line_arena, &tokens, buffer, length);
+    stats_record_since(STAT_TOKENIZE, start);
+
+    bool success = tokenized && parse_tokens(&tokens, buffer);
+
+    // Every token and command of the line came from the arena
+    arena_reset(&line_arena);
+
+    return success;
+}
+
 void send_line()
 {
-    s_vector tokens = {0};
+    // Running the line isn't part of the keystroke's latency
+    keystroke_start = 0;
 
-    putc('\n', stdout);
+    // Keys before this one in the same batch haven't been drawn yet
+    refresh_interactive_line();
+    render_end_line();
 
     // turn back on echo so child process shows input correctly
     set_term_echo_and_canonical(true);
 
-    bool success = false;
-    if (tokenize(&tokens, interactive_line.data, interactive_line.size + 1))
-    {
-        if (parse_tokens(&tokens))
-            success = true;
-    }
+    // A line shown from the history becomes the line's own copy here, since running it writes to it
+    char* text = line_c_str(&interactive_line);
+
+    bool success = execute_line(text, interactive_line.size + 1);
 
     set_term_echo_and_canonical(false);
 
-    if (success && ( line_history.size == 0 || strcmp(interactive_line.data, line_history.data[line_history.size - 1]) ))
-        add_string(&line_history, interactive_line.data, true);
+    job_reap();
+    job_notify();
+
+    if (success)
+        history_add(&line_history, text);
 
     clear_line(&interactive_line);
-    refresh_prompt(true);
+    refresh_prompt();
 }
 
 void clear_screen()
 {
-    move_cursor(1, 1);
-    print_prompt();
-    prompt_start_y = 1;
-    prompt_end_y = prompt_start_y + (prompt_length / win_size_x()); 
-    printf("\033[J");
-}
-
-typedef enum
-{
-    KEY_UNASSIGNED,
-    KEY_ALPHA_NUM_SYMBOL,
-    KEY_ENTER,
-
-    KEY_BACKSPACE,
-    KEY_C_BACKSPACE,
-    KEY_DELETE,
-
-    KEY_LEFT,
-    KEY_RIGHT,
-    KEY_DOWN,
-    KEY_UP,
-
-    KEY_C_LEFT,
-    KEY_C_RIGHT,
-    KEY_C_UP,
-    KEY_C_DOWN,
-
-    KEY_C_AT,
-    KEY_C_A,
-    KEY_C_B,
-    KEY_C_C,
-    KEY_C_D,
-    KEY_C_E,
-    KEY_C_F,
-    KEY_C_G,
-    KEY_C_H,
-    KEY_C_I,
-    KEY_C_J,
-    KEY_C_K,
-    KEY_C_L,
-    KEY_C_M,
-    KEY_C_N,
-    KEY_C_O,
-    KEY_C_P,
-    KEY_C_Q,
-    KEY_C_R,
-    KEY_C_S,
-    KEY_C_T,
-    KEY_C_U,
-    KEY_C_V,
-    KEY_C_W,
-    KEY_C_X,
-    KEY_C_Y,
-    KEY_C_Z,
-    KEY_C_LBRACKET,
-    KEY_C_BACKSLASH,
-    KEY_C_RBRACKET,
-    KEY_C_CARET,
-    KEY_C_UNDERSCORE,
-
-} KEY;
-
-KEY get_input(char* buf)
-{
-    int read_bytes = read(STDIN_FILENO, buf, 16);
-    if (read_bytes == -1)
-    {
-        perror("Read error");
-        exit(EXIT_FAILURE);
-    }
-
-    // print_key_info(buf, read_bytes);
-
-    if (read_bytes == 1 && is_alpha_numeric_symbolic(buf[0])) { return KEY_ALPHA_NUM_SYMBOL; }
-    else if (buf[0] == '\000') return KEY_C_AT;
-    else if (buf[0] == '\001') return KEY_C_A;
-    else if (buf[0] == '\002') return KEY_C_B;
-    else if (buf[0] == '\003') return KEY_C_C;
-    else if (buf[0] == '\004') return KEY_C_D;
-    else if (buf[0] == '\005') return KEY_C_E;
-    else if (buf[0] == '\006') return KEY_C_F;
-    else if (buf[0] == '\007') return KEY_C_G;
-    else if (buf[0] == '\010') return KEY_BACKSPACE; // C-H
-    else if (buf[0] == '\177') return KEY_BACKSPACE;
-    else if (buf[0] == '\011') return KEY_C_I;
-    else if (buf[0] == '\012') return KEY_ENTER; // C-J
-    else if (buf[0] == '\013') return KEY_C_K;
-    else if (buf[0] == '\014') return KEY_C_L;
-    else if (buf[0] == '\015') return KEY_C_M;
-    else if (buf[0] == '\016') return KEY_C_N;
-    else if (buf[0] == '\017') return KEY_C_O;
-    else if (buf[0] == '\020') return KEY_C_P;
-    else if (buf[0] == '\021') return KEY_C_Q;
-    else if (buf[0] == '\022') return KEY_C_R;
-    else if (buf[0] == '\023') return KEY_C_S;
-    else if (buf[0] == '\024') return KEY_C_T;
-    else if (buf[0] == '\025') return KEY_C_U;
-    else if (buf[0] == '\026') return KEY_C_V;
-    else if (buf[0] == '\027') return KEY_C_W;
-    else if (buf[0] == '\030') return KEY_C_X;
-    else if (buf[0] == '\031') return KEY_C_Y;
-    else if (buf[0] == '\032') return KEY_C_Z;
-    else if (buf[0] == '\034') return KEY_C_BACKSLASH;
-    else if (buf[0] == '\035') return KEY_C_RBRACKET;
-    else if (buf[0] == '\036') return KEY_C_CARET;
-    else if (buf[0] == '\037') return KEY_C_UNDERSCORE;
-    else if (buf[0] == 127) return KEY_DELETE;
-    else if (!strcmp(buf, "\033[A"))    return KEY_UP;
-    else if (!strcmp(buf, "\033[B"))    return KEY_DOWN;
-    else if (!strcmp(buf, "\033[C"))    return KEY_RIGHT;
-    else if (!strcmp(buf, "\033[D"))    return KEY_LEFT;
-    else if (!strcmp(buf, "\033[1;5A")) return KEY_C_UP;
-    else if (!strcmp(buf, "\033[1;5B")) return KEY_C_DOWN;
-    else if (!strcmp(buf, "\033[1;5C")) return KEY_C_RIGHT;
-    else if (!strcmp(buf, "\033[1;5D")) return KEY_C_LEFT;
-    else if (!strcmp(buf, "\033[3~"))   return KEY_DELETE;
-    else { return KEY_UNASSIGNED; }
+    printf("\033[H\033[J");
+    refresh_prompt();
 }
 
 KEY previous_key = KEY_UNASSIGNED;
 
+// The history gets indexed ahead of its first search while the editor waits for a key
+static bool history_idle_step()
+{
+    return history_idle(&line_history);
+}
+
+// Handles every key that came in since the last call. The line is drawn once after the whole batch
 void handle_input()
 {
-    char input[16] = {0};
-    KEY key_type = get_input(input);
+    // Wait for input with SIGCHLD unblocked, so finished background jobs wake up the editor
+    sigset_t wait_mask;
+    sigprocmask(SIG_SETMASK, NULL, &wait_mask);
+    sigdelset(&wait_mask, SIGCHLD);
 
-    switch (key_type)
+    bool filled = input_fill(&wait_mask, completion_wake_fd(), history_idle_step);
+    keystroke_start = stats_now();
+
+    if (!filled)
     {
-        case KEY_ENTER:
+        // A directory listing or the command names came in, so the completion waiting on them can go on
+        if (completion_collect() && completion_pending)
+        {
+            completion_pending = false;
+            complete_line(&interactive_line);
+        }
+        return;
+    }
+
+    KEY key_type;
+    char c;
+    while (input_next(&key_type, &c))
+        handle_key(key_type, c);
+}
+
+void handle_key(KEY key_type, char c)
+{
+    completion_listing_size = 0;
+    completion_pending = false;
+
+    if (reverse_searching)
+    {
+        handle_reverse_search_key(key_type, c);
+        previous_key = KEY_UNASSIGNED;
+        return;
+    }
+
+    switch (key_type)
+    {
+        case KEY_ENTER:
             send_line(); break;
         case KEY_C_L:
             clear_screen(); break;
         case KEY_C_P:
             backward_history_search(); break;
+        case KEY_C_R:
+            start_reverse_search(); break;
         case KEY_C_W:
             delete_word_backwards(&interactive_line); break;
+        case KEY_C_I:
+            complete_line(&interactive_line); break;
         case KEY_ALPHA_NUM_SYMBOL:
-            insert_character(&interactive_line, input[0]); break;
+            insert_character(&interactive_line, c); break;
+        case KEY_PASTE:
+            insert_paste(&interactive_line); break;
         case KEY_LEFT:
             move_line_cursor_x(&interactive_line, -1); break;
         case KEY_RIGHT:
@@ -869,7 +993,7 @@ void handle_input()
             remove_character_forward(&interactive_line); break;
         case KEY_C_BACKSPACE:
             delete_word_backwards(&interactive_line); break;
-        case KEY_UNASSIGNED:
+        default:
             break;
     }
 
@@ -879,13 +1003,199 @@ void handle_input()
     }
 }
 
+// The script being run, read in SCRIPT_CHUNK_SIZE chunks so memory use only grows with the longest line
+static int script_fd = -1;
+static char* script_buffer = NULL;
+static size_t script_capacity = 0;
+static size_t script_start = 0; // First byte of the next line
+static size_t script_end = 0;   // End of the data read so far
+static bool script_eof = false;
+
+// Returns the script's next line, newline included, valid until the next call. NULL at the end of the script
+static char* next_script_line(size_t* length)
+{
+    while (true)
+    {
+        char* newline = memchr(script_buffer + script_start, '\n', script_end - script_start);
+        if (!newline)
+        {
+            if (script_eof)
+            {
+                if (script_start == script_end) { return NULL; }
+
+                // There's room for this past the end of the data
+                script_buffer[script_end] = '\n';
+                newline = script_buffer + script_end++;
+            }
+            else
+            {
+                // Move the partial line to the front and read more behind it
+                memmove(script_buffer, script_buffer + script_start, script_end - script_start);
+                script_end -= script_start;
+                script_start = 0;
+
+                if (script_end == script_capacity)
+                {
+                    script_capacity <<= 1;
+                    char* temp = realloc(script_buffer, script_capacity + 1);
+                    if (!temp)
+                    {
+                        perror("realloc");
+                        exit(EXIT_FAILURE);
+                    }
+                    script_buffer = temp;
+                }
+
+                ssize_t nread = read(script_fd, script_buffer + script_end, script_capacity - script_end);
+                if (nread == -1)
+                {
+                    if (errno == EINTR) { continue; }
+                    perror("script read");
+                    exit(EXIT_FAILURE);
+                }
+
+                if (nread == 0)
+                    script_eof = true;
+                script_end += nread;
+                continue;
+            }
+        }
+
+        char* line = script_buffer + script_start;
+        *length = newline - line + 1;
+        script_start += *length;
+
+        return line;
+    }
+}
+
+// Runs a script file one line at a time. Here-documents read their lines from the script too
+void run_script(const char* file_name)
+{
+    script_fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    if (script_fd == -1)
+    {
+        fprintf(stderr, "%s: ", file_name);
+        perror("open");
+        exit(127);
+    }
+
+    // Out of reach of the script's own <&3
+    script_fd = redirect_hide_fd(script_fd);
+
+    script_capacity = SCRIPT_CHUNK_SIZE;
+    script_buffer = malloc(script_capacity + 1); // Room to terminate a last line without a newline
+    if (!script_buffer)
+    {
+        perror("script malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    heredoc_input = next_script_line;
+
+    char* line;
+    size_t length;
+    while ((line = next_script_line(&length)))
+    {
+        // Skip comments, including a #! line
+        char* first = line;
+        while (*first == ' ' || *first == '\t') { first++; }
+        if (*first == '#') { continue; }
+
+        // Reading a here-document can move the buffer, so the line it's part of gets a copy
+        if (memmem(line, length, "<<", 2))
+        {
+            char* copy = strndup(line, length);
+            if (!copy)
+            {
+                perror("script strndup");
+                exit(EXIT_FAILURE);
+            }
+
+            execute_line(copy, length);
+            free(copy);
+        }
+        else
+        {
+            execute_line(line, length);
+        }
+
+        // No notifications without a terminal, but background jobs still need reaping
+        job_reap();
+        job_notify();
+    }
+
+    heredoc_input = NULL;
+    free(script_buffer);
+    script_buffer = NULL;
+    close(script_fd);
+}
+
+// Prompts for a here-document's line on the terminal, which is in canonical mode while a line runs
+static char* read_terminal_line(size_t* length)
+{
+    fputs("> ", stdout);
+    fflush(stdout);
+
+    ssize_t nread = getline(&terminal_line, &terminal_line_capacity, stdin);
+    if (nread == -1)
+    {
+        // Ctrl-D ends the here-document, not the shell
+        clearerr(stdin);
+        fputs("\n", stdout);
+        return NULL;
+    }
+
+    *length = (size_t)nread;
+    return terminal_line;
+}
+
 void run()
 {
-    refresh_prompt(true);
+    if (!interactive)
+    {
+        run_script(script_path);
+        clean_up_mem();
+        exit(last_status);
+    }
+
+    heredoc_input = read_terminal_line;
+
+    refresh_prompt();
     while (true)
     {
         handle_input();
-        refresh_interactive_line();
+
+        // Ctrl-C abandons the line, like in other shells
+        if (line_interrupted)
+        {
+            line_interrupted = 0;
+            if (reverse_searching) { end_reverse_search(false); }
+
+            render_end_line();
+            clear_line(&interactive_line);
+            refresh_prompt();
+        }
+
+        // Report background jobs that finished or stopped while editing, then redraw the prompt below
+        if (child_status_changed && job_reap())
+        {
+            refresh_interactive_line();
+            render_end_line();
+            job_notify();
+            refresh_prompt();
+        }
+
+        if (reverse_searching)
+            refresh_reverse_search();
+        else
+            refresh_interactive_line();
+
+        if (keystroke_start)
+        {
+            stats_record_since(STAT_KEYSTROKE, keystroke_start);
+            keystroke_start = 0;
+        }
     }
 
     clean_up_mem();
@@ -894,54 +1204,81 @@ void run()
 void kill_child(int sig_num)
 {
     UNUSED(sig_num);
-    if (active_child != -1)
-        kill(active_child, SIGINT);
-
-    set_term_echo_and_canonical(false);
-    putchar('\n');
-    // refresh_prompt(true);
+    // With job control the foreground job gets SIGINT from the terminal directly
+    if (active_child != -1 && active_child != shell_pgid)
+        kill(-active_child, SIGINT);
+    else if (active_child == -1)
+        line_interrupted = 1;
 }
 
 void init(int argc, char* argv[])
 {
-    if (argc == 2)
+    if (argc == 2 && !strcmp(argv[1], "--compact-history"))
+    {
+        char* path = history_file_path();
+        if (!path)
+        {
+            fprintf(stderr, "no history file\n");
+            exit(EXIT_FAILURE);
+        }
+
+        int status = history_compact(path);
+        free(path);
+        exit(status);
+    }
+    else if (argc == 2)
     {
-        printf("Not implemented yet!\n");
-        exit(EXIT_SUCCESS);
+        // Script mode never touches the terminal
+        interactive = false;
+        script_path = argv[1];
     }
     else if (argc > 2)
     {
-        fprintf(stderr, "Usage: %s <file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [<file> | --compact-history]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    signal(SIGINT, kill_child);
+    builtin_init();
 
-    initscr();
+    if (interactive)
+    {
+        signal(SIGINT, kill_child);
 
-    initialize_line(&interactive_line);
+        initscr();
+
+        initialize_line(&interactive_line);
+
+        history_load(&line_history);
+    }
+
+    init_job_control(interactive);
 
     add_path(&paths, "/bin/");
     add_path(&paths, "/usr/local/bin/");
 
+    if (interactive)
+        completion_start(&paths, builtin_names, num_builtin_names);
+
     char cwd[PATH_MAX];
     getcwd(cwd, PATH_MAX);
     add_string(&dir_history, cwd, true);
 }
 
 // moves backward through the directory history
-void prevd(const command* command)
+int prevd(int argc, char** argv)
 {
-    if (num_args(command) > 1)
+    UNUSED(argv);
+
+    if (argc > 1)
     {
         printf("prevd: too many arguments\n");
-        return;
+        return 1;
     }
 
     if (current_dir == 0)
     {
         printf("prevd: already at earliest directory\n");
-        return;
+        return 1;
     }
 
     if (chdir(dir_history.data[--current_dir]) == -1)
@@ -949,21 +1286,25 @@ void prevd(const command* command)
         perror("chdir");
         exit(EXIT_FAILURE);
     }
+
+    return 0;
 }
 
 // moves forward through the directory history
-void nextd(const command* command)
+int nextd(int argc, char** argv)
 {
-    if (num_args(command) > 1)
+    UNUSED(argv);
+
+    if (argc > 1)
     {
         printf("prevd: too many arguments\n");
-        return;
+        return 1;
     }
 
     if (current_dir == dir_history.size - 1)
     {
         printf("prevd: already at current directory\n");
-        return;
+        return 1;
     }
 
     if (chdir(dir_history.data[++current_dir]) == -1)
@@ -971,6 +1312,8 @@ void nextd(const command* command)
         perror("chdir");
         exit(EXIT_FAILURE);
     }
+
+    return 0;
 }
 
 int count_digits(int n)
@@ -993,12 +1336,14 @@ int count_digits(int n)
 }
 
 // prints directory history
-void dirh(const command* command)
+int dirh(int argc, char** argv)
 {
-    if (num_args(command) > 1)
+    UNUSED(argv);
+
+    if (argc > 1)
     {
         fprintf(stderr, "prevd: too many arguments\n");
-        return;
+        return 1;
     }
 
     int max_digits = MAX(count_digits((int)dir_history.size - (int)current_dir), count_digits((int)current_dir));
@@ -1015,13 +1360,13 @@ void dirh(const command* command)
             printf("\033[0m"); // Revert from bold
         }
     }
+
+    return 0;
 }
 
-void path(const command* command, s_vector* tokens)
+int path(int argc, char** argv)
 {
-    int numargs = num_args(command);
-
-    if (numargs == 1)
+    if (argc == 1)
     {
         printf("paths:\n");
         for (size_t i = 0; i < paths.size; i++)
@@ -1031,32 +1376,249 @@ void path(const command* command, s_vector* tokens)
     }
     else
     {
-        for (int i = 0; i < numargs - 1; i++)
+        for (int i = 1; i < argc; i++)
+        {
+            add_path(&paths, argv[i]);
+        }
+
+        if (interactive)
+            completion_start(&paths, builtin_names, num_builtin_names);
+    }
+
+    return 0;
+}
+
+static bool ends_word(char c)
+{
+    return c == ' ' || c == '|' || c == ';' || c == '&' || c == '<' || c == '>';
+}
+
+// Start of the word the cursor is in, quoted parts included
+static size_t word_start(const line* l)
+{
+    size_t start = 0;
+    char quote = '\0';
+
+    for (size_t i = 0; i < l->cursor_pos; i++)
+    {
+        char c = line_char_at(l, i);
+
+        if (quote)
+        {
+            if (c == quote) { quote = '\0'; }
+        }
+        else if (c == '\'' || c == '"')
+        {
+            quote = c;
+        }
+        else if (ends_word(c))
+        {
+            start = i + 1;
+        }
+    }
+
+    return start;
+}
+
+// Inserts completed text, quoting it when it holds characters that would end the word
+static void insert_completion(line* l, const char* text, size_t length)
+{
+    bool special = false;
+    bool has_single_quote = false;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (ends_word(text[i]) || text[i] == '\t' || text[i] == '"' || text[i] == '\'') { special = true; }
+        if (text[i] == '\'') { has_single_quote = true; }
+    }
+
+    if (!special)
+    {
+        line_insert(l, text, length);
+        return;
+    }
+
+    char quote = has_single_quote ? '"' : '\'';
+    insert_character(l, quote);
+    line_insert(l, text, length);
+    insert_character(l, quote);
+}
+
+// Completes typed_length bytes to the sorted candidates in names. A single one is inserted whole, several are
+// completed as far as they agree and listed under the line once they no longer do
+static void finish_completion(line* l, char* const* names, size_t count, size_t typed_length)
+{
+    if (!count) { return; }
+
+    size_t common = common_prefix_length(names, count);
+
+    if (common > typed_length)
+        insert_completion(l, names[0] + typed_length, common - typed_length);
+
+    if (count == 1)
+    {
+        // Directories keep going
+        if (names[0][common - 1] != '/')
+            insert_character(l, ' ');
+    }
+    else if (common == typed_length)
+    {
+        completion_listing_size = completion_columns(names, count, win_size_x(), win_size_y() - 2, &completion_listing, &completion_listing_capacity);
+    }
+}
+
+// Shows note under the line until what the completion needs comes in, then it runs again
+static void wait_for_completion(const char* note)
+{
+    size_t length = strlen(note) + sizeof("\033[2m\033[0m");
+    if (completion_listing_capacity < length)
+    {
+        completion_listing_capacity = length;
+        completion_listing = realloc(completion_listing, completion_listing_capacity);
+        if (!completion_listing)
         {
-            add_path(&paths, tokens->data[command->args_start + 1 + i]);
+            perror("completion realloc");
+            exit(EXIT_FAILURE);
         }
     }
+
+    completion_listing_size = sprintf(completion_listing, "\033[2m%s\033[0m", note);
+    completion_pending = true;
 }
 
+// Completes the path in word from a listing of its directory. The first time a directory is needed it's read in
+// the background, and the completion goes on once it's in unless a key was pressed first
+static void complete_path(line* l, const char* word)
+{
+    const char* slash = strrchr(word, '/');
+    const char* base = slash ? slash + 1 : word;
+
+    char dir[PATH_MAX];
+    size_t dir_length = slash ? (size_t)(slash - word) + 1 : 0;
+    if (dir_length >= sizeof(dir)) { return; }
+    memcpy(dir, slash ? word : ".", slash ? dir_length : 2);
+    dir[dir_length ? dir_length : 1] = '\0';
+
+    char* abs_dir = realpath(dir, NULL);
+    if (!abs_dir) { return; }
+
+    const dir_listing* listing = NULL;
+    bool is_dir = file_status(abs_dir) == 1;
+    if (is_dir)
+        listing = completion_directory(abs_dir);
+    free(abs_dir);
+
+    if (!is_dir) { return; }
+    if (!listing)
+    {
+        wait_for_completion("(reading directory)");
+        return;
+    }
+
+    size_t base_length = strlen(base);
+    size_t first = 0;
+    size_t count = listing_find(listing, base, base_length, &first);
+
+    // Hidden files only when asked for. Names starting with '.' are next to each other
+    char* const* names = listing->names + first;
+    if (base[0] != '.')
+    {
+        size_t hidden_start = 0, hidden_end = 0;
+        while (hidden_start < count && names[hidden_start][0] < '.') { hidden_start++; }
+        hidden_end = hidden_start;
+        while (hidden_end < count && names[hidden_end][0] == '.') { hidden_end++; }
+
+        if (hidden_end > hidden_start)
+        {
+            size_t visible = count - (hidden_end - hidden_start);
+            char** shown = malloc(sizeof(*shown) * (visible ? visible : 1));
+            if (!shown)
+            {
+                perror("completion malloc");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(shown, names, sizeof(*shown) * hidden_start);
+            memcpy(shown + hidden_start, names + hidden_end, sizeof(*shown) * (count - hidden_end));
+
+            finish_completion(l, shown, visible, base_length);
+            free(shown);
+            return;
+        }
+    }
+
+    finish_completion(l, names, count, base_length);
+}
+
+// Completes the word before the cursor: a command name where a command goes, a path anywhere else
+void complete_line(line* l)
+{
+    size_t start = word_start(l);
+
+    // The word as the lexer will see it, without its quotes
+    size_t length = 0;
+    char word[l->cursor_pos - start + 1];
+    for (size_t i = start; i < l->cursor_pos; i++)
+    {
+        char c = line_char_at(l, i);
+        if (c != '\'' && c != '"') { word[length++] = c; }
+    }
+    word[length] = '\0';
+
+    size_t before = start;
+    while (before && line_char_at(l, before - 1) == ' ') { before--; }
+
+    // The first word of a command names a command, unless it's a path
+    bool command_position = !before || strchr("|;&", line_char_at(l, before - 1));
+    if (!command_position || strchr(word, '/'))
+    {
+        complete_path(l, word);
+        return;
+    }
+
+    const command_trie* trie = completion_commands(&paths, builtin_names, num_builtin_names);
+
+    size_t first = 0;
+    size_t count = trie ? trie_find(trie, word, length, &first) : 0;
+
+    // The trie being built may have the command the old one doesn't
+    if (!count && completion_building())
+    {
+        wait_for_completion("(reading commands)");
+        return;
+    }
+
+    finish_completion(l, trie ? trie->names + first : NULL, count, length);
+}
+
+// Inserts the last bracketed paste as one edit
+void insert_paste(line* l)
+{
+    size_t size;
+    const char* text = input_paste(&size);
+    line_insert(l, text, size);
+}
+
+// Deletes the word before the cursor along with the whitespace before it, in one edit
 void delete_word_backwards(line* l)
 {
     bool found_non_whitespace = false;
     bool found_whitespace_after_non_white_space = false;
 
-    char current_character = '\0';
-    while(l->cursor_pos > 0)
+    size_t start = l->cursor_pos;
+    while (start > 0)
     {
-        current_character = l->data[l->cursor_pos - 1];
+        char current_character = line_char_at(l, start - 1);
 
         if (current_character != ' ') { found_non_whitespace = true; }
         else if (found_non_whitespace) { found_whitespace_after_non_white_space = true; }
 
-        remove_character(&interactive_line);
+        start--;
         if (found_non_whitespace && found_whitespace_after_non_white_space)
         {
             break;
         }
     }
+
+    line_delete_range(l, start, l->cursor_pos);
 }
 
 void remove_character_forward(line* l)
@@ -1072,10 +1634,20 @@ void backward_history_search()
     bool previously_searched = (previous_key == KEY_UP || previous_key == KEY_C_P || previous_key == KEY_DOWN || previous_key == KEY_C_N);
     if (!previously_searched)
     {
+        // Repeated lines are merged before the indexes into the history are taken
+        history_update(&line_history);
+
         line_history_search_index = (ssize_t)line_history.size - 1;
         clear_line_and_free(&temp_line);
     }
 
+    // Skip over lines that were entered again later
+    if (interactive_line.size == 0 || (!temp_line.size && previously_searched))
+    {
+        while (line_history_search_index >= 0 && !line_history.data[line_history_search_index])
+            line_history_search_index--;
+    }
+
     if (line_history.size == 0 || line_history_search_index == -1)
     {
         previous_key = KEY_UNASSIGNED;
@@ -1090,15 +1662,14 @@ void backward_history_search()
 
     if (interactive_line.size == 0 || (!temp_line.size && previously_searched))
     {
-        clear_line_and_free(&interactive_line);
-        initialize_line_with_new_data(&interactive_line, line_history.data[line_history_search_index]);
+        line_show(&interactive_line, line_history.data[line_history_search_index]);
 
         line_history_search_index--;
     }
     else if (interactive_line.size)
     {
-        char* data_to_search = (previously_searched) ? temp_line.data : interactive_line.data;
-        line_history_search_index = find_index_of_next_string_match(&line_history, line_history_search_index, data_to_search, true);
+        char* data_to_search = (previously_searched) ? line_c_str(&temp_line) : line_c_str(&interactive_line);
+        line_history_search_index = history_search(&line_history, line_history_search_index, data_to_search);
         if (line_history_search_index == -1)
         {
             previous_key = KEY_UNASSIGNED;
@@ -1106,10 +1677,9 @@ void backward_history_search()
         }
 
         if (!previously_searched)
-            initialize_line_with_new_data(&temp_line, interactive_line.data);
+            initialize_line_with_new_data(&temp_line, line_c_str(&interactive_line));
 
-        clear_line_and_free(&interactive_line);
-        initialize_line_with_new_data(&interactive_line, line_history.data[line_history_search_index]);
+        line_show(&interactive_line, line_history.data[line_history_search_index]);
 
 
         line_history_search_index--;
@@ -1129,35 +1699,402 @@ void forward_history_search()
 
     if (temp_line.data == NULL)
     {
-        clear_line_and_free(&interactive_line);
+        clear_line(&interactive_line);
         line_history_search_index++;
+        while (line_history_search_index < (ssize_t)line_history.size - 1 && !line_history.data[line_history_search_index + 1])
+            line_history_search_index++;
+
         if (line_history_search_index < (ssize_t)line_history.size - 1)
         {
-            initialize_line_with_new_data(&interactive_line, line_history.data[line_history_search_index + 1]);
+            line_show(&interactive_line, line_history.data[line_history_search_index + 1]);
+        }
+    }
+
+
+}
+
+// Enters reverse-i-search with whatever was typed as the starting query
+void start_reverse_search()
+{
+    initialize_line_with_new_data(&saved_search_line, line_c_str(&interactive_line));
+
+    history_update(&line_history);
+    reverse_searching = true;
+    update_reverse_search();
+}
+
+// Re-runs the search for the current query
+void update_reverse_search()
+{
+    num_search_results = history_fuzzy_search(&line_history, line_c_str(&interactive_line), search_results, FUZZY_MAX_RESULTS);
+    search_selected = 0;
+}
+
+// Leaves reverse-i-search, putting the selected candidate on the line if accept is set and there is one,
+// or going back to what was typed before the search otherwise
+void end_reverse_search(bool accept)
+{
+    if (accept && num_search_results)
+    {
+        line_show(&interactive_line, line_history.data[search_results[search_selected].index]);
+    }
+    else
+    {
+        clear_line(&interactive_line);
+        line_insert(&interactive_line, line_c_str(&saved_search_line), saved_search_line.size);
+    }
+
+    clear_line_and_free(&saved_search_line);
+    reverse_searching = false;
+    num_search_results = 0;
+}
+
+void handle_reverse_search_key(int key_type, char c)
+{
+    switch (key_type)
+    {
+        case KEY_ALPHA_NUM_SYMBOL:
+            insert_character(&interactive_line, c);
+            update_reverse_search();
+            break;
+        case KEY_BACKSPACE:
+            remove_character(&interactive_line);
+            update_reverse_search();
+            break;
+        case KEY_PASTE:
+            insert_paste(&interactive_line);
+            update_reverse_search();
+            break;
+        case KEY_C_W:
+            delete_word_backwards(&interactive_line);
+            update_reverse_search();
+            break;
+        case KEY_LEFT:
+            move_line_cursor_x(&interactive_line, -1); break;
+        case KEY_C_R:
+        case KEY_C_P:
+        case KEY_UP:
+            if (search_selected + 1 < num_search_results) { search_selected++; }
+            break;
+        case KEY_C_S:
+        case KEY_C_N:
+        case KEY_DOWN:
+            if (search_selected) { search_selected--; }
+            break;
+        case KEY_ENTER:
+            end_reverse_search(true);
+            // Clear the candidates before the command prints anything
+            refresh_interactive_line();
+            send_line();
+            break;
+        case KEY_C_I:
+        case KEY_RIGHT:
+            end_reverse_search(true); break;
+        case KEY_C_G:
+        case KEY_ESCAPE:
+            end_reverse_search(false); break;
+        default:
+            break;
+    }
+}
+
+// Draws the query line with the candidates under it, best first and the selected one highlighted
+void refresh_reverse_search()
+{
+    static char* footer = NULL;
+    static size_t capacity = 0;
+
+    // Rows leave the last column free, so they never wrap
+    int width = MAX(win_size_x() - 1, 3);
+    int shown = MIN((int)num_search_results, win_size_y() - 2);
+
+    size_t needed = 64 + (size_t)MAX(shown, 0) * ((size_t)width + 16);
+    if (needed > capacity)
+    {
+        free(footer);
+        capacity = needed;
+        footer = malloc(capacity);
+        if (!footer)
+        {
+            perror("search malloc");
+            exit(EXIT_FAILURE);
         }
     }
 
+    size_t size = sprintf(footer, "\033[2m(reverse-i-search) %s\033[0m", num_search_results ? "" : "no matches");
 
+    for (int i = 0; i < shown; i++)
+    {
+        const char* candidate = line_history.data[search_results[i].index];
+
+        if ((size_t)i == search_selected)
+            size += sprintf(footer + size, "\n\033[7m> %.*s\033[0m", width - 2, candidate);
+        else
+            size += sprintf(footer + size, "\n  %.*s", width - 2, candidate);
+    }
+
+    render_line(&interactive_line, footer, size);
 }
 
-ssize_t find_index_of_next_string_match(s_vector* haystack, ssize_t current_index, char* needle, bool search_backwards)
+// hash built-in. With no arguments, prints the remembered command locations.
+// 'hash -r' forgets all of them, and 'hash name...' resolves and remembers each name
+int hash(int argc, char** argv)
 {
-    assert(haystack && needle);
-    if (strlen(needle) == 0) { return -1; }
+    if (argc == 1)
+    {
+        hash_print(&cmd_hash);
+        return 0;
+    }
 
-    while (current_index >= 0 && current_index < haystack->size)
+    int status = 0;
+    for (int i = 1; i < argc; i++)
     {
+        char* arg = argv[i];
 
-        char* subset_index = strstr(haystack->data[current_index], needle);
-        if (subset_index != NULL && strlen(needle) < strlen(haystack->data[current_index]))
-            return current_index;
+        if (!strcmp("-r", arg))
+        {
+            hash_clear(&cmd_hash);
+        }
+        else if (strchr(arg, '/'))
+        {
+            continue;
+        }
+        else if (!hash_lookup(&cmd_hash, &paths, arg))
+        {
+            fprintf(stderr, "hash: %s: not found\n", arg);
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+// jobs built-in. Lists the jobs that haven't finished yet
+int jobs_builtin(int argc, char** argv)
+{
+    UNUSED(argv);
 
-        if (search_backwards) 
-            current_index--;
+    if (argc > 1)
+    {
+        fprintf(stderr, "jobs: too many arguments\n");
+        return 1;
+    }
 
-        if (!search_backwards)
-            current_index++;
+    job_reap();
+
+    for (size_t i = 0; i < jobs.size; i++)
+    {
+        print_job(jobs.data[i]);
+        jobs.data[i]->notified = true;
+    }
+
+    // Finished jobs have now been reported
+    for (size_t i = jobs.size; i > 0; i--)
+    {
+        if (jobs.data[i - 1]->state == JOB_DONE)
+            job_remove(jobs.data[i - 1]);
+    }
+
+    return 0;
+}
+
+// Looks up the job named by the only optional argument of fg and bg
+static job* job_argument(int argc, char** argv)
+{
+    if (!job_control)
+    {
+        fprintf(stderr, "%s: no job control\n", argv[0]);
+        return NULL;
+    }
+
+    if (argc > 2)
+    {
+        fprintf(stderr, "%s: too many arguments\n", argv[0]);
+        return NULL;
+    }
+
+    char* spec = argc == 2 ? argv[1] : NULL;
+    job* j = job_find(spec);
+    if (!j)
+        fprintf(stderr, "%s: %s: no such job\n", argv[0], spec ? spec : "current");
+
+    return j;
+}
+
+// fg built-in. Moves a job to the foreground, continuing it if it was stopped
+int fg(int argc, char** argv)
+{
+    job* j = job_argument(argc, argv);
+    if (!j) { return 1; }
+
+    printf("%s\n", j->text);
+    fflush(stdout);
+
+    return job_foreground(j, true);
+}
+
+// bg built-in. Continues a stopped job in the background
+int bg(int argc, char** argv)
+{
+    job* j = job_argument(argc, argv);
+    if (!j) { return 1; }
+
+    if (j->state != JOB_STOPPED)
+    {
+        fprintf(stderr, "bg: job %d already in background\n", j->id);
+        return 1;
+    }
+
+    job_background(j);
+    printf("[%d]+ %s &\n", j->id, j->text);
+    return 0;
+}
+
+// Prints how long a command took and what its processes used, as wait4 reported it
+void print_usage(long elapsed_ns, const struct rusage* usage)
+{
+    fprintf(stderr, "real\t%ld.%03lds\n", elapsed_ns / 1000000000L, elapsed_ns / 1000000L % 1000);
+    fprintf(stderr, "user\t%ld.%03lds\n", (long)usage->ru_utime.tv_sec, (long)usage->ru_utime.tv_usec / 1000);
+    fprintf(stderr, "sys\t%ld.%03lds\n", (long)usage->ru_stime.tv_sec, (long)usage->ru_stime.tv_usec / 1000);
+    fprintf(stderr, "maxrss\t%ld KB\n", usage->ru_maxrss);
+    fprintf(stderr, "faults\t%ld major, %ld minor\n", usage->ru_majflt, usage->ru_minflt);
+    fprintf(stderr, "ctxsw\t%ld voluntary, %ld involuntary\n", usage->ru_nvcsw, usage->ru_nivcsw);
+}
+
+// time built-in. 'time cmd' runs cmd and reports its wall clock time and resource usage.
+// 'time -T ms' reports every command slower than ms from then on, 'time -T 0' stops it, and 'time -T' shows the threshold
+void time_builtin(const command* command, s_vector* tokens)
+{
+    int numargs = num_args(command);
+
+    if (numargs == 1)
+    {
+        fprintf(stderr, "time: usage: time <command> | time -T [ms]\n");
+        last_status = 2;
+        return;
+    }
+
+    if (!strcmp(tokens->data[command->args_start + 1], "-T") && !command->pipe)
+    {
+        if (numargs == 2)
+        {
+            printf("%ld\n", time_threshold_ms);
+            last_status = 0;
+            return;
+        }
+
+        char* end = NULL;
+        long threshold = strtol(tokens->data[command->args_start + 2], &end, 10);
+        if (numargs > 3 || *end || threshold < 0)
+        {
+            fprintf(stderr, "time: -T takes a number of milliseconds\n");
+            last_status = 2;
+            return;
+        }
+
+        time_threshold_ms = threshold;
+        last_status = 0;
+        return;
+    }
+
+    struct command timed = *command;
+    timed.args_start++;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    memset(&last_job_usage, 0, sizeof(last_job_usage));
+
+    run_command(&timed, tokens);
+
+    print_usage(elapsed_since(&start), &last_job_usage);
+}
+
+// rashstat built-in. Shows how long the shell's own work takes: -j prints JSON, -r starts over
+int rashstat(int argc, char** argv)
+{
+    const char* option = argc == 2 ? argv[1] : NULL;
+
+    if (argc > 2 || (option && strcmp(option, "-j") && strcmp(option, "-r")))
+    {
+        fprintf(stderr, "rashstat: usage: rashstat [-j | -r]\n");
+        return 2;
+    }
+
+    if (!option)
+        stats_print(stdout);
+    else if (!strcmp(option, "-j"))
+        stats_print_json(stdout);
+    else
+        stats_reset();
+
+    return 0;
+}
+
+// wait built-in. Waits for the given jobs, or every job if there are no arguments.
+// Exits with the status of the last job waited for
+int wait_builtin(int argc, char** argv)
+{
+    int status = 0;
+
+    if (argc == 1)
+    {
+        while (jobs.size)
+        {
+            job* j = jobs.data[0];
+            job_wait(j);
+            if (j->state == JOB_STOPPED)
+            {
+                fprintf(stderr, "wait: job %d is stopped\n", j->id);
+                return status;
+            }
+
+            status = job_exit_status(j);
+            job_remove(j);
+        }
+        return status;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        job* j = job_find(argv[i]);
+        if (!j)
+        {
+            fprintf(stderr, "wait: %s: no such job\n", argv[i]);
+            status = 127;
+            continue;
+        }
+
+        job_wait(j);
+        if (j->state == JOB_DONE)
+        {
+            status = job_exit_status(j);
+            job_remove(j);
+        }
+    }
+
+    return status;
+}
+
+// exit built-in. Exits with the given status, or the status of the last command
+int exit_builtin(int argc, char** argv)
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "exit: too many arguments\n");
+        return 1;
+    }
+
+    int status = last_status;
+    if (argc == 2)
+    {
+        char* end = NULL;
+        status = (int)strtol(argv[1], &end, 10);
+        if (*end)
+        {
+            fprintf(stderr, "exit: %s: numeric argument required\n", argv[1]);
+            status = 2;
+        }
     }
 
-    return -1;
+    exit(status & 0xff);
 }
@@ -0,0 +1,142 @@
+#include "../include/stats.h"
+
+latency_histogram stats[STAT_COUNT];
+
+static const char* const stat_names[STAT_COUNT] =
+{
+    [STAT_KEYSTROKE] = "keystroke",
+    [STAT_TOKENIZE] = "tokenize",
+    [STAT_PARSE] = "parse",
+    [STAT_RESOLVE] = "resolve",
+    [STAT_SPAWN] = "spawn",
+    [STAT_RUN] = "run",
+};
+
+// Monotonic clock in nanoseconds. Goes through the vDSO, so it costs about as much as a function call
+uint64_t stats_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Values below STATS_SUB_BUCKETS get a bucket each, every power of two above is split STATS_SUB_BUCKETS ways
+static size_t bucket_of(uint64_t ns)
+{
+    if (ns < STATS_SUB_BUCKETS) { return ns; }
+
+    int exponent = 63 - __builtin_clzll(ns);
+    uint64_t sub = (ns >> (exponent - 2)) & (STATS_SUB_BUCKETS - 1);
+
+    return (size_t)(exponent - 1) * STATS_SUB_BUCKETS + sub;
+}
+
+// Smallest value past the bucket
+static uint64_t bucket_end(size_t bucket)
+{
+    if (bucket < STATS_SUB_BUCKETS) { return bucket + 1; }
+
+    int exponent = (int)(bucket / STATS_SUB_BUCKETS) + 1;
+    uint64_t sub = bucket % STATS_SUB_BUCKETS;
+
+    return (STATS_SUB_BUCKETS + sub + 1) << (exponent - 2);
+}
+
+void stats_record(stat_id id, uint64_t ns)
+{
+    latency_histogram* h = &stats[id];
+
+    if (!h->count || ns < h->min_ns) { h->min_ns = ns; }
+    if (ns > h->max_ns) { h->max_ns = ns; }
+
+    h->count++;
+    h->total_ns += ns;
+    h->buckets[bucket_of(ns)]++;
+}
+
+void stats_record_since(stat_id id, uint64_t start_ns)
+{
+    stats_record(id, stats_now() - start_ns);
+}
+
+// Value below which percentile percent of the samples fall, as the end of the bucket it's in, never past the maximum
+uint64_t stats_percentile(const latency_histogram* h, double percentile)
+{
+    if (!h->count) { return 0; }
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)h->count);
+    if (rank >= h->count) { rank = h->count - 1; }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < STATS_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if (seen > rank)
+        {
+            uint64_t end = bucket_end(i);
+            return end < h->max_ns ? end : h->max_ns;
+        }
+    }
+
+    return h->max_ns;
+}
+
+// Writes ns with a unit that keeps it short
+static void print_duration(FILE* out, uint64_t ns)
+{
+    if (ns < 1000)
+        fprintf(out, "%9luns", (unsigned long)ns);
+    else if (ns < 1000000)
+        fprintf(out, "%9.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        fprintf(out, "%9.2fms", ns / 1e6);
+    else
+        fprintf(out, "%9.2fs ", ns / 1e9);
+}
+
+void stats_print(FILE* out)
+{
+    fprintf(out, "%-10s %8s %11s %11s %11s %11s %11s %11s\n", "", "count", "mean", "min", "p50", "p90", "p99", "max");
+
+    for (size_t i = 0; i < STAT_COUNT; i++)
+    {
+        const latency_histogram* h = &stats[i];
+
+        fprintf(out, "%-10s %8lu ", stat_names[i], (unsigned long)h->count);
+        print_duration(out, h->count ? h->total_ns / h->count : 0);
+        fputc(' ', out);
+        print_duration(out, h->min_ns);
+        fputc(' ', out);
+        print_duration(out, stats_percentile(h, 50));
+        fputc(' ', out);
+        print_duration(out, stats_percentile(h, 90));
+        fputc(' ', out);
+        print_duration(out, stats_percentile(h, 99));
+        fputc(' ', out);
+        print_duration(out, h->max_ns);
+        fputc('\n', out);
+    }
+}
+
+void stats_print_json(FILE* out)
+{
+    fputc('{', out);
+
+    for (size_t i = 0; i < STAT_COUNT; i++)
+    {
+        const latency_histogram* h = &stats[i];
+
+        fprintf(out, "%s\"%s\":{\"count\":%lu,\"mean_ns\":%lu,\"min_ns\":%lu,\"p50_ns\":%lu,\"p90_ns\":%lu,\"p99_ns\":%lu,\"max_ns\":%lu}",
+                i ? "," : "", stat_names[i], (unsigned long)h->count, (unsigned long)(h->count ? h->total_ns / h->count : 0),
+                (unsigned long)h->min_ns, (unsigned long)stats_percentile(h, 50), (unsigned long)stats_percentile(h, 90),
+                (unsigned long)stats_percentile(h, 99), (unsigned long)h->max_ns);
+    }
+
+    fputs("}\n", out);
+}
+
+void stats_reset()
+{
+    memset(stats, 0, sizeof(stats));
+}
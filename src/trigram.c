@@ -0,0 +1,223 @@
+#include "../include/trigram.h"
+
+static size_t min_index_capacity = 1024;
+
+// Most posting lists intersected per search. Longer needles are still matched exactly,
+// their remaining trigrams are only checked by the final strstr
+#define TRIGRAM_MAX_LISTS 32
+
+static uint32_t make_trigram(const char* s)
+{
+    return (uint32_t)(unsigned char)s[0] << 16 | (uint32_t)(unsigned char)s[1] << 8 | (unsigned char)s[2];
+}
+
+static size_t hash_trigram(uint32_t trigram)
+{
+    return (size_t)(((uint64_t)trigram * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+// Returns the list of trigram, or the empty slot where it should be inserted
+static posting_list* find_list(posting_list* lists, size_t capacity, uint32_t trigram)
+{
+    size_t i = hash_trigram(trigram) & (capacity - 1);
+
+    while (lists[i].trigram && lists[i].trigram != trigram)
+    {
+        i = (i + 1) & (capacity - 1);
+    }
+
+    return &lists[i];
+}
+
+static void grow_index(trigram_index* index)
+{
+    size_t new_capacity = index->capacity ? index->capacity << 1 : min_index_capacity;
+    posting_list* new_lists = calloc(new_capacity, sizeof(*new_lists));
+    if (!new_lists)
+    {
+        perror("trigram calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < index->capacity; i++)
+    {
+        if (index->lists[i].trigram)
+            *find_list(new_lists, new_capacity, index->lists[i].trigram) = index->lists[i];
+    }
+
+    free(index->lists);
+    index->lists = new_lists;
+    index->capacity = new_capacity;
+}
+
+static void add_posting(trigram_index* index, uint32_t trigram, uint32_t id)
+{
+    if ((index->size + 1) * 2 > index->capacity)
+        grow_index(index);
+
+    posting_list* list = find_list(index->lists, index->capacity, trigram);
+    if (!list->trigram)
+    {
+        list->trigram = trigram;
+        index->size++;
+    }
+
+    // A trigram repeated within one entry is only posted once
+    if (list->size && list->ids[list->size - 1] == id) { return; }
+
+    if (list->size == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity << 1 : 4;
+        uint32_t* temp = realloc(list->ids, sizeof(*list->ids) * list->capacity);
+        if (!temp)
+        {
+            perror("trigram realloc");
+            exit(EXIT_FAILURE);
+        }
+        list->ids = temp;
+    }
+
+    list->ids[list->size++] = id;
+}
+
+// Indexes text as the next entry. NULL entries take up an id without adding anything
+void trigram_index_add(trigram_index* index, const char* text)
+{
+    uint32_t id = (uint32_t)index->num_indexed++;
+    if (!text) { return; }
+
+    for (size_t i = 0; text[i] && text[i + 1] && text[i + 2]; i++)
+        add_posting(index, make_trigram(text + i), id);
+}
+
+// Indexes at most max_entries of the entries added since the last update. Returns true if there are more left
+bool trigram_index_update(trigram_index* index, const s_vector* entries, size_t max_entries)
+{
+    for (size_t i = 0; i < max_entries && index->num_indexed < entries->size; i++)
+        trigram_index_add(index, entries->data[index->num_indexed]);
+
+    return index->num_indexed < entries->size;
+}
+
+// Largest id in list that is at most max_id, or -1
+static ssize_t last_at_most(const posting_list* list, ssize_t max_id)
+{
+    size_t low = 0;
+    size_t high = list->size;
+
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if ((ssize_t)list->ids[mid] <= max_id)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low ? (ssize_t)list->ids[low - 1] : -1;
+}
+
+static bool is_match(const char* entry, const char* needle, size_t needle_length)
+{
+    return entry && strstr(entry, needle) && strlen(entry) > needle_length;
+}
+
+// Needles too short to have a trigram are searched for directly
+static ssize_t scan_backwards(const s_vector* entries, ssize_t current_index, const char* needle, size_t needle_length)
+{
+    for (; current_index >= 0; current_index--)
+    {
+        if (is_match(entries->data[current_index], needle, needle_length))
+            return current_index;
+    }
+
+    return -1;
+}
+
+// Returns the index of the last entry at or before current_index that contains needle and is longer than it,
+// or -1 if there is none. Candidates are the ids present in every posting list of needle's trigrams, found by
+// leapfrogging backwards from the rarest list, so only entries that can match are ever looked at
+ssize_t trigram_index_find(trigram_index* index, const s_vector* entries, ssize_t current_index, const char* needle)
+{
+    size_t needle_length = strlen(needle);
+    if (!needle_length) { return -1; }
+
+    if (current_index >= (ssize_t)entries->size)
+        current_index = (ssize_t)entries->size - 1;
+
+    if (needle_length < 3)
+        return scan_backwards(entries, current_index, needle, needle_length);
+
+    // The newest entries may not be indexed yet, they're checked directly instead of indexing them now
+    for (; current_index >= (ssize_t)index->num_indexed; current_index--)
+    {
+        if (is_match(entries->data[current_index], needle, needle_length))
+            return current_index;
+    }
+
+    // Rarest lists first, they narrow the candidates the fastest
+    const posting_list* lists[TRIGRAM_MAX_LISTS];
+    size_t num_lists = 0;
+
+    for (size_t i = 0; i + 2 < needle_length; i++)
+    {
+        if (!index->capacity) { return -1; }
+
+        const posting_list* list = find_list(index->lists, index->capacity, make_trigram(needle + i));
+        if (!list->trigram) { return -1; }
+
+        bool seen = false;
+        for (size_t k = 0; k < num_lists && !seen; k++)
+            seen = lists[k] == list;
+        if (seen) { continue; }
+
+        if (num_lists == TRIGRAM_MAX_LISTS)
+        {
+            if (list->size >= lists[num_lists - 1]->size) { continue; }
+            num_lists--;
+        }
+
+        size_t k = num_lists++;
+        for (; k > 0 && lists[k - 1]->size > list->size; k--)
+            lists[k] = lists[k - 1];
+        lists[k] = list;
+    }
+
+    ssize_t candidate = current_index;
+    while (candidate >= 0)
+    {
+        bool agreed = true;
+
+        for (size_t k = 0; k < num_lists; k++)
+        {
+            ssize_t id = last_at_most(lists[k], candidate);
+            if (id == -1) { return -1; }
+
+            if (id < candidate)
+            {
+                candidate = id;
+                agreed = false;
+            }
+        }
+
+        if (!agreed) { continue; }
+
+        if (is_match(entries->data[candidate], needle, needle_length))
+            return candidate;
+
+        candidate--;
+    }
+
+    return -1;
+}
+
+void trigram_index_free(trigram_index* index)
+{
+    for (size_t i = 0; i < index->capacity; i++)
+        free(index->lists[i].ids);
+    free(index->lists);
+
+    index->lists = NULL;
+    index->size = index->capacity = 0;
+    index->num_indexed = 0;
+}
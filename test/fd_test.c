@@ -0,0 +1,119 @@
+// Redirections against the shell's own descriptors. Opens what an interactive shell keeps open, the history
+// file and the completion wake pipe, runs lines that write to and read from every descriptor a redirection
+// can name, then checks that a script can't read itself through <&3 and that nothing reached the history.
+// A command with more redirections than a child can take has to fail on its own, leaving the shell running.
+//
+// Usage: fd_test
+#include "../include/shell.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static void run_line(const char* text)
+{
+    char* line = strdup(text);
+    execute_line(line, strlen(line));
+    free(line);
+}
+
+static char* read_file(const char* path, size_t* size)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) { return NULL; }
+
+    char* data = malloc(1 << 16);
+    *size = fread(data, 1, 1 << 16, f);
+    fclose(f);
+    return data;
+}
+
+int main()
+{
+    char dir[] = "/tmp/rash_fd_test_XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    char history_path[64], script_path[64];
+    snprintf(history_path, sizeof(history_path), "%s/history", dir);
+    snprintf(script_path, sizeof(script_path), "%s/script.rash", dir);
+    setenv(HISTORY_FILE_ENV, history_path, 1);
+
+    builtin_init();
+    init_job_control(false);
+    add_path(&paths, "/bin/");
+
+    history_load(&line_history);
+    history_add(&line_history, "before");
+    completion_wake_fd();
+
+    // Nothing of the shell's is where a redirection can name it
+    for (int fd = 3; fd <= REDIR_MAX_FD; fd++)
+        CHECK(fcntl(fd, F_GETFD) == -1);
+
+    // The errors these print are expected. The test's own descriptors stay clear of 3..9 too
+    int saved_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, REDIR_SHELL_FD_MIN);
+    int null_fd = redirect_hide_fd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    dup2(null_fd, STDERR_FILENO);
+
+    char line[64];
+    for (int fd = 3; fd <= REDIR_MAX_FD; fd++)
+    {
+        snprintf(line, sizeof(line), "echo CORRUPT >&%d\n", fd);
+        run_line(line);
+        CHECK(last_status != 0);
+
+        snprintf(line, sizeof(line), "cat <&%d\n", fd);
+        run_line(line);
+        CHECK(last_status != 0);
+    }
+
+    // A script reading <&3 doesn't get its own text
+    FILE* script = fopen(script_path, "w");
+    fputs("cat <&3 > /dev/null\n", script);
+    fclose(script);
+
+    run_script(script_path);
+    CHECK(last_status != 0);
+
+    // One past what fits with the pipe's action, then the next line still runs
+    char crowded[256] = "/bin/echo x";
+    for (int i = 0; i < LAUNCH_MAX_ACTIONS; i++)
+        strcat(crowded, " 2>&1");
+    strcat(crowded, " | cat\n");
+    run_line(crowded);
+    CHECK(last_status != 0);
+
+    run_line("echo x > /dev/null\n");
+    CHECK(last_status == 0);
+
+    dup2(saved_stderr, STDERR_FILENO);
+    close(saved_stderr);
+    close(null_fd);
+
+    history_add(&line_history, "after");
+    history_free(&line_history);
+
+    size_t size = 0;
+    char* data = read_file(history_path, &size);
+    CHECK(data && !memmem(data, size, "CORRUPT\n", 8));
+    free(data);
+
+    // Every record is still there to be read back
+    s_vector reloaded = {NULL, 0, 0};
+    history_load(&reloaded);
+    CHECK(reloaded.size == 2);
+    CHECK(reloaded.size == 2 && !strcmp(reloaded.data[0], "before") && !strcmp(reloaded.data[1], "after"));
+    history_free(&reloaded);
+
+    unlink(history_path);
+    unlink(script_path);
+    rmdir(dir);
+
+    printf("fd_test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+// History files with damaged bytes. A torn last record, like a crash mid-write leaves, and junk between
+// records, like something else writing to the file, must not keep records appended later from being read back,
+// nor the records between two damaged regions.
+// Then checks that a line entered before the dedup table covers the loaded history still replaces its older copy,
+// and that searches find entries before and after the index covers them.
+//
+// Usage: history_test
+#include "../include/history.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+static void write_record(FILE* f, const char* text)
+{
+    uint32_t length = strlen(text);
+    int64_t timestamp = 1700000000;
+    fwrite(&length, sizeof(length), 1, f);
+    fwrite(&timestamp, sizeof(timestamp), 1, f);
+    fwrite(text, 1, length + 1, f);
+}
+
+// Loads the file, appends line, and loads it again. Returns the entries as they were read back
+static s_vector append_and_reload(const char* line)
+{
+    s_vector history = {NULL, 0, 0};
+    history_load(&history);
+    history_add(&history, line);
+    history_free(&history);
+
+    history_load(&history);
+    return history;
+}
+
+static bool has_entries(const s_vector* history, const char* const* expected, size_t num_expected)
+{
+    if (history->size != num_expected) { return false; }
+
+    for (size_t i = 0; i < num_expected; i++)
+    {
+        if (strcmp(history->data[i], expected[i]))
+            return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    char dir[] = "/tmp/rash_history_test_XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/history", dir);
+    setenv(HISTORY_FILE_ENV, path, 1);
+
+    // The repairs are reported on stderr
+    freopen("/dev/null", "w", stderr);
+
+    // Torn tail: the header and part of the text of a last record
+    FILE* f = fopen(path, "wb");
+    fwrite(HISTORY_MAGIC, 1, HISTORY_MAGIC_SIZE, f);
+    write_record(f, "one");
+    write_record(f, "two");
+    uint32_t torn_length = 40;
+    fwrite(&torn_length, sizeof(torn_length), 1, f);
+    fwrite("\0\0\0\0\0\0\0\0partial", 1, 15, f);
+    fclose(f);
+
+    s_vector history = append_and_reload("three");
+    const char* const torn[] = { "one", "two", "three" };
+    CHECK(has_entries(&history, torn, 3));
+    history_free(&history);
+
+    // Junk between records, with good records after it
+    f = fopen(path, "wb");
+    fwrite(HISTORY_MAGIC, 1, HISTORY_MAGIC_SIZE, f);
+    write_record(f, "one");
+    fputs("CORRUPT\n", f);
+    write_record(f, "two");
+    write_record(f, "three");
+    fclose(f);
+
+    history = append_and_reload("four");
+    const char* const junk[] = { "one", "two", "three", "four" };
+    CHECK(has_entries(&history, junk, 4));
+    history_free(&history);
+
+    // The repaired file has no junk left for the next load to skip
+    f = fopen(path, "rb");
+    char data[4096];
+    size_t size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    CHECK(!memmem(data, size, "CORRUPT", 7));
+
+    // Two damaged regions, the records between them are kept too
+    f = fopen(path, "wb");
+    fwrite(HISTORY_MAGIC, 1, HISTORY_MAGIC_SIZE, f);
+    write_record(f, "one");
+    fputs("CORRUPT\n", f);
+    const char* const between[] = { "two", "three", "four", "five" };
+    for (size_t i = 0; i < 4; i++)
+        write_record(f, between[i]);
+    fputs("CORRUPT AGAIN\n", f);
+    write_record(f, "six");
+    fclose(f);
+
+    history = append_and_reload("seven");
+    const char* const regions[] = { "one", "two", "three", "four", "five", "six", "seven" };
+    CHECK(has_entries(&history, regions, 7));
+    history_free(&history);
+
+    // Back to the file the compaction below starts from
+    f = fopen(path, "wb");
+    fwrite(HISTORY_MAGIC, 1, HISTORY_MAGIC_SIZE, f);
+    for (size_t i = 0; i < 4; i++)
+        write_record(f, junk[i]);
+    fclose(f);
+
+    // Compaction steps over junk too
+    f = fopen(path, "ab");
+    fputs("more junk", f);
+    write_record(f, "five");
+    fclose(f);
+
+    // So is what it kept
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    int status = history_compact(path);
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    CHECK(status == EXIT_SUCCESS);
+
+    history_load(&history);
+    const char* const compacted[] = { "one", "two", "three", "four", "five" };
+    CHECK(has_entries(&history, compacted, 5));
+    history_free(&history);
+
+    // More entries than one idle step dedups, with a line repeated at both ends
+    f = fopen(path, "wb");
+    fwrite(HISTORY_MAGIC, 1, HISTORY_MAGIC_SIZE, f);
+    write_record(f, "repeated");
+    char text[32];
+    for (int i = 0; i < HISTORY_IDLE_STEP; i++)
+    {
+        snprintf(text, sizeof(text), "line %d", i);
+        write_record(f, text);
+    }
+    fclose(f);
+
+    // Searches find entries whether or not the index covers them yet
+    history_load(&history);
+    CHECK(history_search(&history, history.size - 1, "line 129") == 1300);
+    CHECK(history_idle(&history));
+    history_add(&history, "repeated");
+    while (history_idle(&history)) { }
+
+    size_t num_repeated = 0;
+    for (size_t i = 0; i < history.size; i++)
+        num_repeated += history.data[i] && !strcmp(history.data[i], "repeated");
+    CHECK(num_repeated == 1);
+    CHECK(!history.data[0] && !strcmp(history.data[history.size - 1], "repeated"));
+    CHECK(history_search(&history, history.size - 1, "line 129") == 1300);
+    history_free(&history);
+
+    unlink(path);
+    rmdir(dir);
+
+    printf("history_test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}